@@ -27,13 +27,19 @@
 #include "SDL2.h"
 #include "audio.h"
 #include "rwops.h"
+#include "stats.h"
+#include "video.h"
 
 DECLSPEC int SDLCALL SDL_AudioInit (const char *driver_name) {
 	return rSDL_AudioInit(driver_name);
 }
 
+static void ring_stop (void);
+
 DECLSPEC void SDLCALL SDL_AudioQuit (void) {
+	/* Closes the device, so the ring can go after it */
 	rSDL_AudioQuit();
+	ring_stop();
 }
 
 typedef struct SDL1_AudioSpec {
@@ -57,24 +63,198 @@ static callback_data cbdata;
 static SDL_AudioSpec audio_spec;
 
 static void SDLCALL callback (void *userdata, Uint8 *stream, int len) {
+	Uint64 start = SDLCL_StatStart();
 	(void)userdata;
 	memset(stream, audio_spec.silence, len);
 	cbdata.callback(cbdata.userdata, stream, len);
+	SDLCL_StatEnd(SDLCL_STAT_AUDIO, start);
+}
+
+/* With SDLCL_AUDIO_RING, the application's callback runs ahead of time on a
+ * producer thread, filling a ring of whole periods (audio_spec.size bytes
+ * each), and the device callback only copies them out. The ring has a
+ * single producer and a single consumer, each advancing its own index, so
+ * neither side ever waits on the other. SDL_LockAudio() locks ring_lock,
+ * which is held around every call to the application's callback.
+ * Applications may close the device with the lock held, so each thread
+ * counts its SDL_LockAudio() calls, and closing releases the caller's.
+ */
+#define MAX_RING_PERIODS 32
+
+static Uint8 *ring_buf = NULL;
+static Uint32 ring_period, ring_periods;
+static Uint32 ring_offset;          /* Bytes already taken from the period at ring_read */
+static SDL_atomic_t ring_read;      /* Next period to play, in [0, 2 * ring_periods) */
+static SDL_atomic_t ring_write;     /* Next period to fill, in [0, 2 * ring_periods) */
+static SDL_sem *ring_wake = NULL;   /* Posted when a period is freed, on unpause and on quit */
+static SDL_sem *ring_ready = NULL;  /* Posted when a period is filled while priming */
+static SDL_mutex *ring_lock = NULL;
+static SDL_Thread *ring_thread = NULL;
+static volatile int ring_paused, ring_priming, ring_quit;
+static __thread int ring_lock_depth;     /* This thread's SDL_LockAudio() calls on ring_lock */
+static __thread int ring_lock_released;  /* ...of those, how many closing already released */
+static SDLCL_AudioStats audio_stats;
+
+/* Each index is only written by its own side, so a CAS from its current
+ * value always succeeds; it is used for the full barrier around it.
+ */
+static int ring_get (SDL_atomic_t *a) {
+	int value;
+	do value = a->value; while (!rSDL_AtomicCAS(a, value, value));
+	return value;
+}
+
+static void ring_set (SDL_atomic_t *a, int value) {
+	rSDL_AtomicCAS(a, a->value, value);
+}
+
+static int ring_next (int index) {
+	return (Uint32)(index + 1) % (ring_periods * 2);
+}
+
+static Uint32 ring_fill (int read, int write) {
+	return (Uint32)(write - read + ring_periods * 2) % (ring_periods * 2);
+}
+
+static Uint8 *ring_slot (int index) {
+	return ring_buf + (Uint32)index % ring_periods * ring_period;
+}
+
+static void SDLCALL ring_callback (void *userdata, Uint8 *stream, int len) {
+	if (!ring_buf) {
+		callback(userdata, stream, len);
+		return;
+	}
+	while (len > 0) {
+		int read = ring_read.value;
+		Uint32 n;
+		if (read == ring_get(&ring_write)) {
+			memset(stream, audio_spec.silence, len);
+			audio_stats.underruns++;
+			break;
+		}
+		n = ring_period - ring_offset;
+		if (n > (Uint32)len) n = len;
+		memcpy(stream, ring_slot(read) + ring_offset, n);
+		stream += n;
+		len -= n;
+		ring_offset += n;
+		if (ring_offset == ring_period) {
+			ring_offset = 0;
+			ring_set(&ring_read, ring_next(read));
+			rSDL_SemPost(ring_wake);
+		}
+	}
+}
+
+static int SDLCALL ring_main (void *data) {
+	Uint64 budget = rSDL_GetPerformanceFrequency() * audio_spec.samples / audio_spec.freq;
+	(void)data;
+	while (!ring_quit) {
+		int write = ring_write.value;
+		Uint8 *stream;
+		Uint64 start, stat;
+		if (ring_paused || ring_fill(ring_get(&ring_read), write) == ring_periods) {
+			rSDL_SemWait(ring_wake);
+			continue;
+		}
+		stream = ring_slot(write);
+		rSDL_LockMutex(ring_lock);
+		if (ring_quit) {
+			rSDL_UnlockMutex(ring_lock);
+			break;
+		}
+		stat = SDLCL_StatStart();
+		start = rSDL_GetPerformanceCounter();
+		memset(stream, audio_spec.silence, ring_period);
+		cbdata.callback(cbdata.userdata, stream, ring_period);
+		if (rSDL_GetPerformanceCounter() - start > budget) audio_stats.overruns++;
+		SDLCL_StatEnd(SDLCL_STAT_AUDIO, stat);
+		rSDL_UnlockMutex(ring_lock);
+		audio_stats.periods++;
+		ring_set(&ring_write, ring_next(write));
+		if (ring_priming) rSDL_SemPost(ring_ready);
+	}
+	return 0;
+}
+
+static void ring_stop (void) {
+	if (ring_thread) {
+		ring_quit = 1;
+		/* The producer may be waiting for a ring_lock this thread holds;
+		 * the SDL_UnlockAudio() calls still to come then do nothing
+		 */
+		while (ring_lock_depth > 0) {
+			rSDL_UnlockMutex(ring_lock);
+			ring_lock_depth--;
+			ring_lock_released++;
+		}
+		rSDL_SemPost(ring_wake);
+		rSDL_WaitThread(ring_thread, NULL);
+		ring_thread = NULL;
+	}
+	if (ring_wake) rSDL_DestroySemaphore(ring_wake);
+	if (ring_ready) rSDL_DestroySemaphore(ring_ready);
+	if (ring_lock) rSDL_DestroyMutex(ring_lock);
+	free(ring_buf);
+	ring_wake = NULL;
+	ring_ready = NULL;
+	ring_lock = NULL;
+	ring_buf = NULL;
+}
+
+/* Called once the device is open (and paused). If this fails, the device
+ * callback falls back to calling the application's callback directly.
+ */
+static void ring_start (int periods) {
+	if (!audio_spec.size || !audio_spec.freq) return;
+	if (periods < 2) periods = 2;
+	if (periods > MAX_RING_PERIODS) periods = MAX_RING_PERIODS;
+	ring_period = audio_spec.size;
+	ring_periods = periods;
+	ring_offset = 0;
+	ring_read.value = 0;
+	ring_write.value = 0;
+	ring_paused = 1;
+	ring_priming = 0;
+	ring_quit = 0;
+	ring_wake = rSDL_CreateSemaphore(0);
+	ring_ready = rSDL_CreateSemaphore(0);
+	ring_lock = rSDL_CreateMutex();
+	ring_buf = malloc((size_t)ring_period * ring_periods);
+	if (ring_wake && ring_ready && ring_lock && ring_buf)
+		ring_thread = rSDL_CreateThread(ring_main, "SDLCL audio", NULL);
+	if (!ring_thread) ring_stop();
+}
+
+static int ring_periods_env (void) {
+	const char *env = getenv("SDLCL_AUDIO_RING");
+	return env ? atoi(env) : 0;
+}
+
+DECLSPEC void SDLCALL SDLCL_GetAudioStats (SDLCL_AudioStats *stats) {
+	*stats = audio_stats;
+}
+
+DECLSPEC void SDLCALL SDLCL_ResetAudioStats (void) {
+	memset(&audio_stats, 0, sizeof(audio_stats));
 }
 
 DECLSPEC int SDLCALL SDL_OpenAudio (SDL1_AudioSpec *desired, SDL1_AudioSpec *obtained) {
 	SDL_AudioSpec desired2;
+	int periods = ring_periods_env();
 	memset(&desired2, 0, sizeof(SDL_AudioSpec));
 	desired2.freq = desired->freq;
 	desired2.format = desired->format;
 	desired2.channels = desired->channels;
 	desired2.samples = desired->samples;
-	desired2.callback = callback;
+	desired2.callback = periods > 0 ? ring_callback : callback;
 	desired2.userdata = NULL;
 	if (obtained) {
 		if (!rSDL_OpenAudio(&desired2, &audio_spec)) {
 			cbdata.callback = desired->callback;
 			cbdata.userdata = desired->userdata;
+			if (periods > 0) ring_start(periods);
 			obtained->freq = audio_spec.freq;
 			obtained->format = audio_spec.format;
 			obtained->channels = audio_spec.channels;
@@ -87,6 +267,9 @@ DECLSPEC int SDLCALL SDL_OpenAudio (SDL1_AudioSpec *desired, SDL1_AudioSpec *obt
 		if (!rSDL_OpenAudio(&desired2, NULL)) {
 			cbdata.callback = desired->callback;
 			cbdata.userdata = desired->userdata;
+			/* SDL 2.0 fills in the size and silence of the desired spec */
+			audio_spec = desired2;
+			if (periods > 0) ring_start(periods);
 			return 0;
 		}
 	}
@@ -94,6 +277,20 @@ DECLSPEC int SDLCALL SDL_OpenAudio (SDL1_AudioSpec *desired, SDL1_AudioSpec *obt
 }
 
 DECLSPEC void SDLCALL SDL_PauseAudio (int pause_on) {
+	if (ring_thread) {
+		ring_paused = pause_on;
+		if (!pause_on && ring_get(&ring_read) == ring_get(&ring_write)) {
+			/* Give the producer a head start of one period, so the device
+			 * doesn't begin with an underrun
+			 */
+			Uint32 ms = audio_spec.samples * 1000 / audio_spec.freq + 1;
+			while (!rSDL_SemTryWait(ring_ready));
+			ring_priming = 1;
+			rSDL_SemPost(ring_wake);
+			rSDL_SemWaitTimeout(ring_ready, ms * 2);
+			ring_priming = 0;
+		}
+	}
 	rSDL_PauseAudio(pause_on);
 }
 
@@ -117,15 +314,24 @@ DECLSPEC void SDLCALL SDL_MixAudio (Uint8 *dst, Uint8 *src, Uint32 len, int volu
 }
 
 DECLSPEC void SDLCALL SDL_LockAudio (void) {
-	rSDL_LockAudio();
+	if (ring_thread) {
+		rSDL_LockMutex(ring_lock);
+		ring_lock_depth++;
+	} else rSDL_LockAudio();
 }
 
 DECLSPEC void SDLCALL SDL_UnlockAudio (void) {
-	rSDL_UnlockAudio();
+	if (ring_lock_released > 0) {
+		ring_lock_released--;
+	} else if (ring_thread) {
+		ring_lock_depth--;
+		rSDL_UnlockMutex(ring_lock);
+	} else rSDL_UnlockAudio();
 }
 
 DECLSPEC void SDLCALL SDL_CloseAudio (void) {
 	rSDL_CloseAudio();
+	ring_stop();
 }
 
 DECLSPEC char *SDLCALL SDL_AudioDriverName (char *namebuf, int maxlen) {
@@ -20,8 +20,18 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
 #include "SDL2.h"
 #include "audio.h"
+#include "cpuinfo.h"
+#include "video.h"
+
+#ifdef SDLCL_X86_SIMD
+#include <immintrin.h>
+#endif
 
 typedef struct SDL1_AudioCVT {
 	int needed;
@@ -37,22 +47,359 @@ typedef struct SDL1_AudioCVT {
 	int filter_index;
 } SDL1_AudioCVT;
 
+/* SIMD kernels for the filters below. Each one handles a prefix of the
+ * buffer that is a multiple of CVT_SIMD_CHUNK bytes and leaves the rest to
+ * the scalar loop, giving bit-identical results. Shrinking kernels work
+ * front to back and expanding ones back to front, like the filters, so
+ * they are safe in place.
+ */
+#define CVT_SIMD_CHUNK 64
+
+/* Ways of halving a buffer: keep the even or odd units, or average pairs */
+enum {
+	HALVE_EVEN8,
+	HALVE_ODD8,
+	HALVE_EVEN16,
+	HALVE_EVEN32,
+	HALVE_EVEN64,
+	HALVE_MONO_U8,
+	HALVE_MONO_S8,
+	HALVE_MONO_U16,
+	HALVE_MONO_S16
+};
+
+typedef struct cvt_kernels {
+	void (*swap16) (Uint8 *buf, int len);
+	void (*xor16) (Uint8 *buf, int len, Uint16 mask);
+	void (*halve) (Uint8 *buf, int len, int op);
+	void (*dup) (Uint8 *buf, int len, int unit);
+	void (*widen) (Uint8 *buf, int len, int msb);
+} cvt_kernels;
+
+static const cvt_kernels *cvt_simd = NULL;
+
+#ifdef SDLCL_X86_SIMD
+__attribute__((target("sse2")))
+static void swap16_sse2 (Uint8 *buf, int len) {
+	__m128i v;
+	for (; len > 0; len -= 16, buf += 16) {
+		v = _mm_loadu_si128((__m128i *)buf);
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i *)buf, v);
+	}
+}
+
+__attribute__((target("sse2")))
+static void xor16_sse2 (Uint8 *buf, int len, Uint16 mask) {
+	__m128i m = _mm_set1_epi16((short)mask);
+	__m128i v;
+	for (; len > 0; len -= 16, buf += 16) {
+		v = _mm_loadu_si128((__m128i *)buf);
+		_mm_storeu_si128((__m128i *)buf, _mm_xor_si128(v, m));
+	}
+}
+
+/* Pair averages truncate towards zero, as the C division does */
+__attribute__((target("sse2")))
+static __m128i halve_sse2 (__m128i a, __m128i b, int op) {
+	__m128i lo8 = _mm_set1_epi16(0x00FF), lo16 = _mm_set1_epi32(0xFFFF);
+	__m128i ea, oa, eb, ob;
+	switch (op) {
+		case HALVE_EVEN8:
+			return _mm_packus_epi16(_mm_and_si128(a, lo8), _mm_and_si128(b, lo8));
+		case HALVE_ODD8:
+			return _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+		case HALVE_EVEN16:
+			a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+			b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+			return _mm_packs_epi32(a, b);
+		case HALVE_EVEN32:
+			return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a),
+				_mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+		case HALVE_EVEN64:
+			return _mm_unpacklo_epi64(a, b);
+		case HALVE_MONO_U8:
+			a = _mm_add_epi16(_mm_and_si128(a, lo8), _mm_srli_epi16(a, 8));
+			b = _mm_add_epi16(_mm_and_si128(b, lo8), _mm_srli_epi16(b, 8));
+			return _mm_packus_epi16(_mm_srli_epi16(a, 1), _mm_srli_epi16(b, 1));
+		case HALVE_MONO_S8:
+			ea = _mm_srai_epi16(_mm_slli_epi16(a, 8), 8);
+			oa = _mm_srai_epi16(a, 8);
+			eb = _mm_srai_epi16(_mm_slli_epi16(b, 8), 8);
+			ob = _mm_srai_epi16(b, 8);
+			a = _mm_add_epi16(ea, oa);
+			b = _mm_add_epi16(eb, ob);
+			a = _mm_srai_epi16(_mm_add_epi16(a, _mm_srli_epi16(a, 15)), 1);
+			b = _mm_srai_epi16(_mm_add_epi16(b, _mm_srli_epi16(b, 15)), 1);
+			return _mm_packs_epi16(a, b);
+		case HALVE_MONO_U16:
+			a = _mm_add_epi32(_mm_and_si128(a, lo16), _mm_srli_epi32(a, 16));
+			b = _mm_add_epi32(_mm_and_si128(b, lo16), _mm_srli_epi32(b, 16));
+			/* Sign extend so the saturating pack keeps the low 16 bits */
+			a = _mm_srai_epi32(_mm_slli_epi32(_mm_srli_epi32(a, 1), 16), 16);
+			b = _mm_srai_epi32(_mm_slli_epi32(_mm_srli_epi32(b, 1), 16), 16);
+			return _mm_packs_epi32(a, b);
+		case HALVE_MONO_S16:
+			ea = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+			oa = _mm_srai_epi32(a, 16);
+			eb = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+			ob = _mm_srai_epi32(b, 16);
+			a = _mm_add_epi32(ea, oa);
+			b = _mm_add_epi32(eb, ob);
+			a = _mm_srai_epi32(_mm_add_epi32(a, _mm_srli_epi32(a, 31)), 1);
+			b = _mm_srai_epi32(_mm_add_epi32(b, _mm_srli_epi32(b, 31)), 1);
+			return _mm_packs_epi32(a, b);
+	}
+	return a;
+}
+
+__attribute__((target("sse2")))
+static void halve_buf_sse2 (Uint8 *buf, int len, int op) {
+	Uint8 *dst = buf;
+	__m128i a, b;
+	for (; len > 0; len -= 32, buf += 32, dst += 16) {
+		a = _mm_loadu_si128((__m128i *)buf);
+		b = _mm_loadu_si128((__m128i *)(buf + 16));
+		_mm_storeu_si128((__m128i *)dst, halve_sse2(a, b, op));
+	}
+}
+
+__attribute__((target("sse2")))
+static void dup_sse2 (Uint8 *buf, int len, int unit) {
+	__m128i v, lo, hi;
+	for (len -= 16; len >= 0; len -= 16) {
+		v = _mm_loadu_si128((__m128i *)(buf + len));
+		switch (unit) {
+			case 1: lo = _mm_unpacklo_epi8(v, v); hi = _mm_unpackhi_epi8(v, v); break;
+			case 2: lo = _mm_unpacklo_epi16(v, v); hi = _mm_unpackhi_epi16(v, v); break;
+			case 4: lo = _mm_unpacklo_epi32(v, v); hi = _mm_unpackhi_epi32(v, v); break;
+			default: lo = _mm_unpacklo_epi64(v, v); hi = _mm_unpackhi_epi64(v, v); break;
+		}
+		_mm_storeu_si128((__m128i *)(buf + len * 2), lo);
+		_mm_storeu_si128((__m128i *)(buf + len * 2 + 16), hi);
+	}
+}
+
+__attribute__((target("sse2")))
+static void widen_sse2 (Uint8 *buf, int len, int msb) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i v, lo, hi;
+	for (len -= 16; len >= 0; len -= 16) {
+		v = _mm_loadu_si128((__m128i *)(buf + len));
+		if (msb) {
+			lo = _mm_unpacklo_epi8(v, zero);
+			hi = _mm_unpackhi_epi8(v, zero);
+		} else {
+			lo = _mm_unpacklo_epi8(zero, v);
+			hi = _mm_unpackhi_epi8(zero, v);
+		}
+		_mm_storeu_si128((__m128i *)(buf + len * 2), lo);
+		_mm_storeu_si128((__m128i *)(buf + len * 2 + 16), hi);
+	}
+}
+
+static const cvt_kernels cvt_sse2 = {
+	swap16_sse2, xor16_sse2, halve_buf_sse2, dup_sse2, widen_sse2
+};
+
+__attribute__((target("avx2")))
+static void swap16_avx2 (Uint8 *buf, int len) {
+	__m256i v;
+	for (; len > 0; len -= 32, buf += 32) {
+		v = _mm256_loadu_si256((__m256i *)buf);
+		v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+		_mm256_storeu_si256((__m256i *)buf, v);
+	}
+}
+
+__attribute__((target("avx2")))
+static void xor16_avx2 (Uint8 *buf, int len, Uint16 mask) {
+	__m256i m = _mm256_set1_epi16((short)mask);
+	__m256i v;
+	for (; len > 0; len -= 32, buf += 32) {
+		v = _mm256_loadu_si256((__m256i *)buf);
+		_mm256_storeu_si256((__m256i *)buf, _mm256_xor_si256(v, m));
+	}
+}
+
+/* Same as halve_sse2() within each 128-bit lane; the caller puts the lanes
+ * back in order
+ */
+__attribute__((target("avx2")))
+static __m256i halve_avx2 (__m256i a, __m256i b, int op) {
+	__m256i lo8 = _mm256_set1_epi16(0x00FF), lo16 = _mm256_set1_epi32(0xFFFF);
+	__m256i ea, oa, eb, ob;
+	switch (op) {
+		case HALVE_EVEN8:
+			return _mm256_packus_epi16(_mm256_and_si256(a, lo8), _mm256_and_si256(b, lo8));
+		case HALVE_ODD8:
+			return _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+		case HALVE_EVEN16:
+			a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+			b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+			return _mm256_packs_epi32(a, b);
+		case HALVE_EVEN32:
+			return _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a),
+				_mm256_castsi256_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+		case HALVE_EVEN64:
+			return _mm256_unpacklo_epi64(a, b);
+		case HALVE_MONO_U8:
+			a = _mm256_add_epi16(_mm256_and_si256(a, lo8), _mm256_srli_epi16(a, 8));
+			b = _mm256_add_epi16(_mm256_and_si256(b, lo8), _mm256_srli_epi16(b, 8));
+			return _mm256_packus_epi16(_mm256_srli_epi16(a, 1), _mm256_srli_epi16(b, 1));
+		case HALVE_MONO_S8:
+			ea = _mm256_srai_epi16(_mm256_slli_epi16(a, 8), 8);
+			oa = _mm256_srai_epi16(a, 8);
+			eb = _mm256_srai_epi16(_mm256_slli_epi16(b, 8), 8);
+			ob = _mm256_srai_epi16(b, 8);
+			a = _mm256_add_epi16(ea, oa);
+			b = _mm256_add_epi16(eb, ob);
+			a = _mm256_srai_epi16(_mm256_add_epi16(a, _mm256_srli_epi16(a, 15)), 1);
+			b = _mm256_srai_epi16(_mm256_add_epi16(b, _mm256_srli_epi16(b, 15)), 1);
+			return _mm256_packs_epi16(a, b);
+		case HALVE_MONO_U16:
+			a = _mm256_add_epi32(_mm256_and_si256(a, lo16), _mm256_srli_epi32(a, 16));
+			b = _mm256_add_epi32(_mm256_and_si256(b, lo16), _mm256_srli_epi32(b, 16));
+			a = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_srli_epi32(a, 1), 16), 16);
+			b = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_srli_epi32(b, 1), 16), 16);
+			return _mm256_packs_epi32(a, b);
+		case HALVE_MONO_S16:
+			ea = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+			oa = _mm256_srai_epi32(a, 16);
+			eb = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+			ob = _mm256_srai_epi32(b, 16);
+			a = _mm256_add_epi32(ea, oa);
+			b = _mm256_add_epi32(eb, ob);
+			a = _mm256_srai_epi32(_mm256_add_epi32(a, _mm256_srli_epi32(a, 31)), 1);
+			b = _mm256_srai_epi32(_mm256_add_epi32(b, _mm256_srli_epi32(b, 31)), 1);
+			return _mm256_packs_epi32(a, b);
+	}
+	return a;
+}
+
+__attribute__((target("avx2")))
+static void halve_buf_avx2 (Uint8 *buf, int len, int op) {
+	Uint8 *dst = buf;
+	__m256i a, b, v;
+	for (; len > 0; len -= 64, buf += 64, dst += 32) {
+		a = _mm256_loadu_si256((__m256i *)buf);
+		b = _mm256_loadu_si256((__m256i *)(buf + 32));
+		v = _mm256_permute4x64_epi64(halve_avx2(a, b, op), _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)dst, v);
+	}
+}
+
+/* Each 64-bit quarter is copied to both halves of a lane first, so the
+ * in-lane unpacks produce the duplicated units in order
+ */
+__attribute__((target("avx2")))
+static void dup_avx2 (Uint8 *buf, int len, int unit) {
+	__m256i v, lo, hi;
+	for (len -= 32; len >= 0; len -= 32) {
+		v = _mm256_loadu_si256((__m256i *)(buf + len));
+		lo = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 1, 0, 0));
+		hi = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 3, 2, 2));
+		switch (unit) {
+			case 1: lo = _mm256_unpacklo_epi8(lo, lo); hi = _mm256_unpacklo_epi8(hi, hi); break;
+			case 2: lo = _mm256_unpacklo_epi16(lo, lo); hi = _mm256_unpacklo_epi16(hi, hi); break;
+			case 4: lo = _mm256_unpacklo_epi32(lo, lo); hi = _mm256_unpacklo_epi32(hi, hi); break;
+			default: lo = _mm256_unpacklo_epi64(lo, lo); hi = _mm256_unpacklo_epi64(hi, hi); break;
+		}
+		_mm256_storeu_si256((__m256i *)(buf + len * 2), lo);
+		_mm256_storeu_si256((__m256i *)(buf + len * 2 + 32), hi);
+	}
+}
+
+__attribute__((target("avx2")))
+static void widen_avx2 (Uint8 *buf, int len, int msb) {
+	__m256i v, lo, hi;
+	for (len -= 32; len >= 0; len -= 32) {
+		v = _mm256_loadu_si256((__m256i *)(buf + len));
+		lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v));
+		hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1));
+		if (!msb) {
+			lo = _mm256_slli_epi16(lo, 8);
+			hi = _mm256_slli_epi16(hi, 8);
+		}
+		_mm256_storeu_si256((__m256i *)(buf + len * 2), lo);
+		_mm256_storeu_si256((__m256i *)(buf + len * 2 + 32), hi);
+	}
+}
+
+static const cvt_kernels cvt_avx2 = {
+	swap16_avx2, xor16_avx2, halve_buf_avx2, dup_avx2, widen_avx2
+};
+#endif
+
+/* Conversions may run on other threads meanwhile, so cvt_simd is only
+ * ever stored once per call, and filters read it once into a local.
+ */
+static void init_cvt_simd (void) {
+	const cvt_kernels *simd = NULL;
+#ifdef SDLCL_X86_SIMD
+	switch (SDLCL_GetSIMDLevel()) {
+		case SDLCL_SIMD_AVX2: simd = &cvt_avx2; break;
+		case SDLCL_SIMD_SSE2: simd = &cvt_sse2; break;
+		default: break;
+	}
+#endif
+	cvt_simd = simd;
+}
+
+/* Length of the prefix the SIMD kernels should handle */
+static int simd_len (const cvt_kernels *simd, int len) {
+	return simd ? len & ~(CVT_SIMD_CHUNK - 1) : 0;
+}
+
+/* Expanding filters work down from the end of the buffer in whole units,
+ * so a partial unit left by an earlier filter shifts them off the SIMD
+ * prefix; leave those buffers to the scalar loop
+ */
+static int simd_expand_len (SDL1_AudioCVT *cvt, const cvt_kernels *simd, int unit) {
+	return (cvt->len_cvt % unit) ? 0 : simd_len(simd, cvt->len_cvt);
+}
+
+/* Halve the SIMD part of the buffer, returning the number of bytes used */
+static int simd_halve (SDL1_AudioCVT *cvt, int op) {
+	const cvt_kernels *simd = cvt_simd;
+	int n = simd_len(simd, cvt->len_cvt);
+	if (n) simd->halve(cvt->buf, n, op);
+	return n;
+}
+
+/* Kernel selector for dropping every other unit of the given size */
+static int even_op (int unit) {
+	switch (unit) {
+		case 1: return HALVE_EVEN8;
+		case 2: return HALVE_EVEN16;
+		case 4: return HALVE_EVEN32;
+		default: return HALVE_EVEN64;
+	}
+}
+
 /* Effectively mix right and left channels into a single channel */
 static void SDLCALL SDL_ConvertMono (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	int i, n;
 	Sint32 sample;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting to mono\n");
 #endif
+	switch (format&0x9018) {
+		case AUDIO1_U8: n = simd_halve(cvt, HALVE_MONO_U8); break;
+		case AUDIO1_S8: n = simd_halve(cvt, HALVE_MONO_S8); break;
+		case AUDIO1_U16LSB: n = simd_halve(cvt, HALVE_MONO_U16); break;
+		case AUDIO1_S16LSB: n = simd_halve(cvt, HALVE_MONO_S16); break;
+		default: n = 0; break;
+	}
 	switch (format&0x8018) {
 
 		case AUDIO1_U8: {
 			Uint8 *src, *dst;
 
-			src = cvt->buf;
-			dst = cvt->buf;
-			for ( i=cvt->len_cvt/2; i; --i ) {
+			src = cvt->buf+n;
+			dst = cvt->buf+n/2;
+			for ( i=(cvt->len_cvt-n)/2; i; --i ) {
 				sample = src[0] + src[1];
 				*dst = (Uint8)(sample / 2);
 				src += 2;
@@ -64,9 +411,9 @@ static void SDLCALL SDL_ConvertMono (SDL1_AudioCVT *cvt, Uint16 format) {
 		case AUDIO1_S8: {
 			Sint8 *src, *dst;
 
-			src = (Sint8 *)cvt->buf;
-			dst = (Sint8 *)cvt->buf;
-			for ( i=cvt->len_cvt/2; i; --i ) {
+			src = (Sint8 *)cvt->buf+n;
+			dst = (Sint8 *)cvt->buf+n/2;
+			for ( i=(cvt->len_cvt-n)/2; i; --i ) {
 				sample = src[0] + src[1];
 				*dst = (Sint8)(sample / 2);
 				src += 2;
@@ -78,10 +425,10 @@ static void SDLCALL SDL_ConvertMono (SDL1_AudioCVT *cvt, Uint16 format) {
 		case AUDIO1_U16: {
 			Uint8 *src, *dst;
 
-			src = cvt->buf;
-			dst = cvt->buf;
+			src = cvt->buf+n;
+			dst = cvt->buf+n/2;
 			if ( (format & 0x1000) == 0x1000 ) {
-				for ( i=cvt->len_cvt/4; i; --i ) {
+				for ( i=(cvt->len_cvt-n)/4; i; --i ) {
 					sample = (Uint16)((src[0]<<8)|src[1])+
 					         (Uint16)((src[2]<<8)|src[3]);
 					sample /= 2;
@@ -92,7 +439,7 @@ static void SDLCALL SDL_ConvertMono (SDL1_AudioCVT *cvt, Uint16 format) {
 					dst += 2;
 				}
 			} else {
-				for ( i=cvt->len_cvt/4; i; --i ) {
+				for ( i=(cvt->len_cvt-n)/4; i; --i ) {
 					sample = (Uint16)((src[1]<<8)|src[0])+
 					         (Uint16)((src[3]<<8)|src[2]);
 					sample /= 2;
@@ -109,10 +456,10 @@ static void SDLCALL SDL_ConvertMono (SDL1_AudioCVT *cvt, Uint16 format) {
 		case AUDIO1_S16: {
 			Uint8 *src, *dst;
 
-			src = cvt->buf;
-			dst = cvt->buf;
+			src = cvt->buf+n;
+			dst = cvt->buf+n/2;
 			if ( (format & 0x1000) == 0x1000 ) {
-				for ( i=cvt->len_cvt/4; i; --i ) {
+				for ( i=(cvt->len_cvt-n)/4; i; --i ) {
 					sample = (Sint16)((src[0]<<8)|src[1])+
 					         (Sint16)((src[2]<<8)|src[3]);
 					sample /= 2;
@@ -123,7 +470,7 @@ static void SDLCALL SDL_ConvertMono (SDL1_AudioCVT *cvt, Uint16 format) {
 					dst += 2;
 				}
 			} else {
-				for ( i=cvt->len_cvt/4; i; --i ) {
+				for ( i=(cvt->len_cvt-n)/4; i; --i ) {
 					sample = (Sint16)((src[1]<<8)|src[0])+
 					         (Sint16)((src[3]<<8)|src[2]);
 					sample /= 2;
@@ -374,17 +721,19 @@ static void SDLCALL SDL_ConvertStrip_2 (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Duplicate a mono channel to both stereo channels */
 static void SDLCALL SDL_ConvertStereo (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	const cvt_kernels *simd = cvt_simd;
+	int i, n;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting to stereo\n");
 #endif
+	n = simd_expand_len(cvt, simd, (format & 0xFF) / 8);
 	if ( (format & 0xFF) == 16 ) {
 		Uint16 *src, *dst;
 
 		src = (Uint16 *)(cvt->buf+cvt->len_cvt);
 		dst = (Uint16 *)(cvt->buf+cvt->len_cvt*2);
-		for ( i=cvt->len_cvt/2; i; --i ) {
+		for ( i=(cvt->len_cvt-n)/2; i; --i ) {
 			dst -= 2;
 			src -= 1;
 			dst[0] = src[0];
@@ -395,13 +744,16 @@ static void SDLCALL SDL_ConvertStereo (SDL1_AudioCVT *cvt, Uint16 format) {
 
 		src = cvt->buf+cvt->len_cvt;
 		dst = cvt->buf+cvt->len_cvt*2;
-		for ( i=cvt->len_cvt; i; --i ) {
+		for ( i=cvt->len_cvt-n; i; --i ) {
 			dst -= 2;
 			src -= 1;
 			dst[0] = src[0];
 			dst[1] = src[0];
 		}
 	}
+	if ( n ) {
+		simd->dup(cvt->buf, n, (format & 0xFF) / 8);
+	}
 	cvt->len_cvt *= 2;
 	if ( cvt->filters[++cvt->filter_index] ) {
 		cvt->filters[cvt->filter_index](cvt, format);
@@ -739,20 +1091,25 @@ static void SDLCALL SDL_ConvertSurround_4 (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Convert 8-bit to 16-bit - LSB */
 static void SDLCALL SDL_Convert16LSB (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	const cvt_kernels *simd = cvt_simd;
+	int i, n;
 	Uint8 *src, *dst;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting to 16-bit LSB\n");
 #endif
+	n = simd_len(simd, cvt->len_cvt);
 	src = cvt->buf+cvt->len_cvt;
 	dst = cvt->buf+cvt->len_cvt*2;
-	for ( i=cvt->len_cvt; i; --i ) {
+	for ( i=cvt->len_cvt-n; i; --i ) {
 		src -= 1;
 		dst -= 2;
 		dst[1] = *src;
 		dst[0] = 0;
 	}
+	if ( n ) {
+		simd->widen(cvt->buf, n, 0);
+	}
 	format = ((format & ~0x0008) | AUDIO1_U16LSB);
 	cvt->len_cvt *= 2;
 	if ( cvt->filters[++cvt->filter_index] ) {
@@ -761,20 +1118,25 @@ static void SDLCALL SDL_Convert16LSB (SDL1_AudioCVT *cvt, Uint16 format) {
 }
 /* Convert 8-bit to 16-bit - MSB */
 static void SDLCALL SDL_Convert16MSB (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	const cvt_kernels *simd = cvt_simd;
+	int i, n;
 	Uint8 *src, *dst;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting to 16-bit MSB\n");
 #endif
+	n = simd_len(simd, cvt->len_cvt);
 	src = cvt->buf+cvt->len_cvt;
 	dst = cvt->buf+cvt->len_cvt*2;
-	for ( i=cvt->len_cvt; i; --i ) {
+	for ( i=cvt->len_cvt-n; i; --i ) {
 		src -= 1;
 		dst -= 2;
 		dst[0] = *src;
 		dst[1] = 0;
 	}
+	if ( n ) {
+		simd->widen(cvt->buf, n, 1);
+	}
 	format = ((format & ~0x0008) | AUDIO1_U16MSB);
 	cvt->len_cvt *= 2;
 	if ( cvt->filters[++cvt->filter_index] ) {
@@ -784,18 +1146,19 @@ static void SDLCALL SDL_Convert16MSB (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Convert 16-bit to 8-bit */
 static void SDLCALL SDL_Convert8 (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	int i, n;
 	Uint8 *src, *dst;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting to 8-bit\n");
 #endif
-	src = cvt->buf;
-	dst = cvt->buf;
+	n = simd_halve(cvt, (format & 0x1000) ? HALVE_EVEN8 : HALVE_ODD8);
+	src = cvt->buf+n;
+	dst = cvt->buf+n/2;
 	if ( (format & 0x1000) != 0x1000 ) { /* Little endian */
 		++src;
 	}
-	for ( i=cvt->len_cvt/2; i; --i ) {
+	for ( i=(cvt->len_cvt-n)/2; i; --i ) {
 		*dst = *src;
 		src += 2;
 		dst += 1;
@@ -809,23 +1172,33 @@ static void SDLCALL SDL_Convert8 (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Toggle signed/unsigned */
 static void SDLCALL SDL_ConvertSign (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	const cvt_kernels *simd = cvt_simd;
+	int i, n;
 	Uint8 *data;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting audio signedness\n");
 #endif
 	data = cvt->buf;
+	n = simd_len(simd, cvt->len_cvt);
+	if ( n ) {
+		if ( (format & 0xFF) == 16 ) {
+			simd->xor16(data, n, (format & 0x1000) ? 0x0080 : 0x8000);
+		} else {
+			simd->xor16(data, n, 0x8080);
+		}
+		data += n;
+	}
 	if ( (format & 0xFF) == 16 ) {
 		if ( (format & 0x1000) != 0x1000 ) { /* Little endian */
 			++data;
 		}
-		for ( i=cvt->len_cvt/2; i; --i ) {
+		for ( i=(cvt->len_cvt-n)/2; i; --i ) {
 			*data ^= 0x80;
 			data += 2;
 		}
 	} else {
-		for ( i=cvt->len_cvt; i; --i ) {
+		for ( i=cvt->len_cvt-n; i; --i ) {
 			*data++ ^= 0x80;
 		}
 	}
@@ -837,14 +1210,20 @@ static void SDLCALL SDL_ConvertSign (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Toggle endianness */
 static void SDLCALL SDL_ConvertEndian (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	const cvt_kernels *simd = cvt_simd;
+	int i, n;
 	Uint8 *data, tmp;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting audio endianness\n");
 #endif
 	data = cvt->buf;
-	for ( i=cvt->len_cvt/2; i; --i ) {
+	n = simd_len(simd, cvt->len_cvt);
+	if ( n ) {
+		simd->swap16(data, n);
+		data += n;
+	}
+	for ( i=(cvt->len_cvt-n)/2; i; --i ) {
 		tmp = data[0];
 		data[0] = data[1];
 		data[1] = tmp;
@@ -858,17 +1237,19 @@ static void SDLCALL SDL_ConvertEndian (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Convert rate up by multiple of 2 */
 static void SDLCALL SDL_RateMUL2 (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	const cvt_kernels *simd = cvt_simd;
+	int i, n;
 	Uint8 *src, *dst;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting audio rate * 2\n");
 #endif
+	n = simd_expand_len(cvt, simd, (format & 0xFF) / 8);
 	src = cvt->buf+cvt->len_cvt;
 	dst = cvt->buf+cvt->len_cvt*2;
 	switch (format & 0xFF) {
 		case 8:
-			for ( i=cvt->len_cvt; i; --i ) {
+			for ( i=cvt->len_cvt-n; i; --i ) {
 				src -= 1;
 				dst -= 2;
 				dst[0] = src[0];
@@ -876,7 +1257,7 @@ static void SDLCALL SDL_RateMUL2 (SDL1_AudioCVT *cvt, Uint16 format) {
 			}
 			break;
 		case 16:
-			for ( i=cvt->len_cvt/2; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/2; i; --i ) {
 				src -= 2;
 				dst -= 4;
 				dst[0] = src[0];
@@ -886,6 +1267,9 @@ static void SDLCALL SDL_RateMUL2 (SDL1_AudioCVT *cvt, Uint16 format) {
 			}
 			break;
 	}
+	if ( n ) {
+		simd->dup(cvt->buf, n, (format & 0xFF) / 8);
+	}
 	cvt->len_cvt *= 2;
 	if ( cvt->filters[++cvt->filter_index] ) {
 		cvt->filters[cvt->filter_index](cvt, format);
@@ -895,17 +1279,19 @@ static void SDLCALL SDL_RateMUL2 (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Convert rate up by multiple of 2, for stereo */
 static void SDLCALL SDL_RateMUL2_c2 (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	const cvt_kernels *simd = cvt_simd;
+	int i, n;
 	Uint8 *src, *dst;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting audio rate * 2\n");
 #endif
+	n = simd_expand_len(cvt, simd, (format & 0xFF) / 8 * 2);
 	src = cvt->buf+cvt->len_cvt;
 	dst = cvt->buf+cvt->len_cvt*2;
 	switch (format & 0xFF) {
 		case 8:
-			for ( i=cvt->len_cvt/2; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/2; i; --i ) {
 				src -= 2;
 				dst -= 4;
 				dst[0] = src[0];
@@ -915,7 +1301,7 @@ static void SDLCALL SDL_RateMUL2_c2 (SDL1_AudioCVT *cvt, Uint16 format) {
 			}
 			break;
 		case 16:
-			for ( i=cvt->len_cvt/4; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/4; i; --i ) {
 				src -= 4;
 				dst -= 8;
 				dst[0] = src[0];
@@ -929,6 +1315,9 @@ static void SDLCALL SDL_RateMUL2_c2 (SDL1_AudioCVT *cvt, Uint16 format) {
 			}
 			break;
 	}
+	if ( n ) {
+		simd->dup(cvt->buf, n, (format & 0xFF) / 8 * 2);
+	}
 	cvt->len_cvt *= 2;
 	if ( cvt->filters[++cvt->filter_index] ) {
 		cvt->filters[cvt->filter_index](cvt, format);
@@ -937,17 +1326,19 @@ static void SDLCALL SDL_RateMUL2_c2 (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Convert rate up by multiple of 2, for quad */
 static void SDLCALL SDL_RateMUL2_c4 (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	const cvt_kernels *simd = cvt_simd;
+	int i, n;
 	Uint8 *src, *dst;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting audio rate * 2\n");
 #endif
+	n = simd_expand_len(cvt, simd, (format & 0xFF) / 8 * 4);
 	src = cvt->buf+cvt->len_cvt;
 	dst = cvt->buf+cvt->len_cvt*2;
 	switch (format & 0xFF) {
 		case 8:
-			for ( i=cvt->len_cvt/4; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/4; i; --i ) {
 				src -= 4;
 				dst -= 8;
 				dst[0] = src[0];
@@ -961,7 +1352,7 @@ static void SDLCALL SDL_RateMUL2_c4 (SDL1_AudioCVT *cvt, Uint16 format) {
 			}
 			break;
 		case 16:
-			for ( i=cvt->len_cvt/8; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/8; i; --i ) {
 				src -= 8;
 				dst -= 16;
 				dst[0] = src[0];
@@ -983,6 +1374,9 @@ static void SDLCALL SDL_RateMUL2_c4 (SDL1_AudioCVT *cvt, Uint16 format) {
 			}
 			break;
 	}
+	if ( n ) {
+		simd->dup(cvt->buf, n, (format & 0xFF) / 8 * 4);
+	}
 	cvt->len_cvt *= 2;
 	if ( cvt->filters[++cvt->filter_index] ) {
 		cvt->filters[cvt->filter_index](cvt, format);
@@ -1058,24 +1452,25 @@ static void SDLCALL SDL_RateMUL2_c6 (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Convert rate down by multiple of 2 */
 static void SDLCALL SDL_RateDIV2 (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	int i, n;
 	Uint8 *src, *dst;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting audio rate / 2\n");
 #endif
-	src = cvt->buf;
-	dst = cvt->buf;
+	n = simd_halve(cvt, even_op((format & 0xFF) / 8));
+	src = cvt->buf+n;
+	dst = cvt->buf+n/2;
 	switch (format & 0xFF) {
 		case 8:
-			for ( i=cvt->len_cvt/2; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/2; i; --i ) {
 				dst[0] = src[0];
 				src += 2;
 				dst += 1;
 			}
 			break;
 		case 16:
-			for ( i=cvt->len_cvt/4; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/4; i; --i ) {
 				dst[0] = src[0];
 				dst[1] = src[1];
 				src += 4;
@@ -1092,17 +1487,18 @@ static void SDLCALL SDL_RateDIV2 (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Convert rate down by multiple of 2, for stereo */
 static void SDLCALL SDL_RateDIV2_c2 (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	int i, n;
 	Uint8 *src, *dst;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting audio rate / 2\n");
 #endif
-	src = cvt->buf;
-	dst = cvt->buf;
+	n = simd_halve(cvt, even_op((format & 0xFF) / 8 * 2));
+	src = cvt->buf+n;
+	dst = cvt->buf+n/2;
 	switch (format & 0xFF) {
 		case 8:
-			for ( i=cvt->len_cvt/4; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/4; i; --i ) {
 				dst[0] = src[0];
 				dst[1] = src[1];
 				src += 4;
@@ -1110,7 +1506,7 @@ static void SDLCALL SDL_RateDIV2_c2 (SDL1_AudioCVT *cvt, Uint16 format) {
 			}
 			break;
 		case 16:
-			for ( i=cvt->len_cvt/8; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/8; i; --i ) {
 				dst[0] = src[0];
 				dst[1] = src[1];
 				dst[2] = src[2];
@@ -1129,17 +1525,18 @@ static void SDLCALL SDL_RateDIV2_c2 (SDL1_AudioCVT *cvt, Uint16 format) {
 
 /* Convert rate down by multiple of 2, for quad */
 static void SDLCALL SDL_RateDIV2_c4 (SDL1_AudioCVT *cvt, Uint16 format) {
-	int i;
+	int i, n;
 	Uint8 *src, *dst;
 
 #ifdef DEBUG_CONVERT
 	fprintf(stderr, "Converting audio rate / 2\n");
 #endif
-	src = cvt->buf;
-	dst = cvt->buf;
+	n = simd_halve(cvt, even_op((format & 0xFF) / 8 * 4));
+	src = cvt->buf+n;
+	dst = cvt->buf+n/2;
 	switch (format & 0xFF) {
 		case 8:
-			for ( i=cvt->len_cvt/8; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/8; i; --i ) {
 				dst[0] = src[0];
 				dst[1] = src[1];
 				dst[2] = src[2];
@@ -1149,7 +1546,7 @@ static void SDLCALL SDL_RateDIV2_c4 (SDL1_AudioCVT *cvt, Uint16 format) {
 			}
 			break;
 		case 16:
-			for ( i=cvt->len_cvt/16; i; --i ) {
+			for ( i=(cvt->len_cvt-n)/16; i; --i ) {
 				dst[0] = src[0];
 				dst[1] = src[1];
 				dst[2] = src[2];
@@ -1217,79 +1614,301 @@ static void SDLCALL SDL_RateDIV2_c6 (SDL1_AudioCVT *cvt, Uint16 format) {
 	}
 }
 
-/* Very slow rate conversion routine */
-/*static void SDLCALL SDL_RateSLOW (SDL1_AudioCVT *cvt, Uint16 format) {
-	double ipos;
-	int i, clen;
+/* Arbitrary ratio rate conversion with a windowed sinc filter. The filter
+ * is tabulated at SINC_PHASES fractional positions between two input
+ * samples, and each output sample uses the row nearest to its position.
+ * Tables depend only on the ratio, so they are built by SDL_BuildAudioCVT()
+ * and kept for later conversions.
+ */
+#define SINC_TAPS 16
+#define SINC_PHASE_BITS 9
+#define SINC_PHASES (1 << SINC_PHASE_BITS)
+#define SINC_TABLES 8
+/* Frames of padding around each channel, at least half the taps */
+#define SINC_PAD SINC_TAPS
+
+typedef struct sinc_table {
+	double rate_incr;
+	float coefs[SINC_PHASES][SINC_TAPS];
+} sinc_table;
 
-#ifdef DEBUG_CONVERT
-	fprintf(stderr, "Converting audio rate * %4.4f\n", 1.0/cvt->rate_incr);
+typedef float (*dot_func)(const float *x, const float *h);
+
+/* Tables are never freed, since conversions in other threads may use them */
+static sinc_table *sinc_tables[SINC_TABLES];
+static int num_sinc_tables = 0;
+static SDL_SpinLock sinc_lock = 0;
+static dot_func sinc_dot = NULL;
+
+/* All versions add the products in the same order, so the SIMD levels
+ * give identical output: taps i, i+8, i+4 and i+12 are summed into four
+ * lanes, which are then added in pairs.
+ */
+static float dot_c (const float *x, const float *h) {
+	float lane[4];
+	int i;
+	for (i = 0; i < 4; i++) {
+		lane[i] = (x[i] * h[i] + x[i + 8] * h[i + 8]) +
+			(x[i + 4] * h[i + 4] + x[i + 12] * h[i + 12]);
+	}
+	return (lane[0] + lane[2]) + (lane[1] + lane[3]);
+}
+
+#ifdef SDLCL_X86_SIMD
+__attribute__((target("sse2")))
+static float dot_sse2 (const float *x, const float *h) {
+	__m128 lo = _mm_mul_ps(_mm_loadu_ps(x), _mm_loadu_ps(h));
+	__m128 hi = _mm_mul_ps(_mm_loadu_ps(x + 4), _mm_loadu_ps(h + 4));
+	__m128 sum;
+	lo = _mm_add_ps(lo, _mm_mul_ps(_mm_loadu_ps(x + 8), _mm_loadu_ps(h + 8)));
+	hi = _mm_add_ps(hi, _mm_mul_ps(_mm_loadu_ps(x + 12), _mm_loadu_ps(h + 12)));
+	sum = _mm_add_ps(lo, hi);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2")))
+static float dot_avx2 (const float *x, const float *h) {
+	__m256 sum = _mm256_mul_ps(_mm256_loadu_ps(x), _mm256_loadu_ps(h));
+	__m128 half;
+	sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(x + 8), _mm256_loadu_ps(h + 8)));
+	half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+	half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+	return _mm_cvtss_f32(half);
+}
 #endif
-	clen = (int)((double)cvt->len_cvt / cvt->rate_incr);
-	if ( cvt->rate_incr > 1.0 ) {
-		switch (format & 0xFF) {
-			case 8: {
-				Uint8 *output;
-
-				output = cvt->buf;
-				ipos = 0.0;
-				for ( i=clen; i; --i ) {
-					*output = cvt->buf[(int)ipos];
-					ipos += cvt->rate_incr;
-					output += 1;
-				}
-			}
-			break;
 
-			case 16: {
-				Uint16 *output;
+static void build_sinc_table (sinc_table *table, double rate_incr) {
+	/* Pass what fits below the lower of the two Nyquist frequencies,
+	 * leaving some room for the filter to roll off
+	 */
+	double cutoff = (rate_incr > 1.0 ? 1.0 / rate_incr : 1.0) * 0.95;
+	double t, x, c, sum;
+	float *row;
+	int p, k;
+	table->rate_incr = rate_incr;
+	for (p = 0; p < SINC_PHASES; p++) {
+		row = table->coefs[p];
+		sum = 0;
+		for (k = 0; k < SINC_TAPS; k++) {
+			/* Distance from the output position to input sample k */
+			t = (k - (SINC_TAPS / 2 - 1)) - (double)p / SINC_PHASES;
+			x = M_PI * cutoff * t;
+			c = fabs(x) < 1e-9 ? 1.0 : sin(x) / x;
+			/* Blackman window over the width of the filter */
+			x = M_PI * t / (SINC_TAPS / 2);
+			c *= 0.42 + 0.5 * cos(x) + 0.08 * cos(2 * x);
+			row[k] = (float)c;
+			sum += c;
+		}
+		/* Keep the gain at exactly 1 for every phase */
+		for (k = 0; k < SINC_TAPS; k++) row[k] = (float)(row[k] / sum);
+	}
+}
 
-				clen &= ~1;
-				output = (Uint16 *)cvt->buf;
-				ipos = 0.0;
-				for ( i=clen/2; i; --i ) {
-					*output=((Uint16 *)cvt->buf)[(int)ipos];
-					ipos += cvt->rate_incr;
-					output += 1;
-				}
-			}
+/* Find the table for a ratio, building it if there is room for another */
+static const sinc_table *get_sinc_table (double rate_incr) {
+	sinc_table *table = NULL;
+	int i;
+	rSDL_AtomicLock(&sinc_lock);
+	if (!sinc_dot) {
+		sinc_dot = dot_c;
+#ifdef SDLCL_X86_SIMD
+		switch (SDLCL_GetSIMDLevel()) {
+			case SDLCL_SIMD_AVX2: sinc_dot = dot_avx2; break;
+			case SDLCL_SIMD_SSE2: sinc_dot = dot_sse2; break;
+			default: break;
+		}
+#endif
+	}
+	for (i = 0; i < num_sinc_tables; i++) {
+		if (sinc_tables[i]->rate_incr == rate_incr) {
+			table = sinc_tables[i];
 			break;
 		}
+	}
+	if (!table && num_sinc_tables < SINC_TABLES) {
+		table = malloc(sizeof(sinc_table));
+		if (table) {
+			build_sinc_table(table, rate_incr);
+			sinc_tables[num_sinc_tables++] = table;
+		}
+	}
+	rSDL_AtomicUnlock(&sinc_lock);
+	return table;
+}
+
+static float get_sample (const Uint8 *src, Uint16 format) {
+	int v;
+	if ((format & 0xFF) == 8) {
+		v = (format & 0x8000) ? (Sint8)src[0] : src[0] - 128;
+		return (float)(v * 256);
+	}
+	v = (format & 0x1000) ? (src[0] << 8) | src[1] : (src[1] << 8) | src[0];
+	return (float)((format & 0x8000) ? (Sint16)v : v - 32768);
+}
+
+static void put_sample (Uint8 *dst, Uint16 format, float sample) {
+	int v = (int)(sample < 0 ? sample - 0.5f : sample + 0.5f);
+	if (v < -32768) v = -32768;
+	else if (v > 32767) v = 32767;
+	if ((format & 0xFF) == 8) {
+		v >>= 8;
+		dst[0] = (Uint8)((format & 0x8000) ? v : v + 128);
+		return;
+	}
+	if (!(format & 0x8000)) v += 32768;
+	if (format & 0x1000) {
+		dst[0] = (Uint8)(v >> 8);
+		dst[1] = (Uint8)v;
 	} else {
-		switch (format & 0xFF) {
-			case 8: {
-				Uint8 *output;
-
-				output = cvt->buf+clen;
-				ipos = (double)cvt->len_cvt;
-				for ( i=clen; i; --i ) {
-					ipos -= cvt->rate_incr;
-					output -= 1;
-					*output = cvt->buf[(int)ipos];
-				}
-			}
-			break;
+		dst[0] = (Uint8)v;
+		dst[1] = (Uint8)(v >> 8);
+	}
+}
 
-			case 16: {
-				Uint16 *output;
+static void rate_sinc (SDL1_AudioCVT *cvt, Uint16 format, int channels) {
+	const sinc_table *table;
+	sinc_table *own = NULL;
+	float *planes, *plane;
+	const float *row;
+	Uint8 *p;
+	Uint64 pos, step;
+	int bytes = (format & 0xFF) / 8;
+	int frame = bytes * channels;
+	int frames = cvt->len_cvt / frame;
+	int stride = frames + 2 * SINC_PAD;
+	int out, i, c;
 
-				clen &= ~1;
-				output = (Uint16 *)(cvt->buf+clen);
-				ipos = (double)cvt->len_cvt/2;
-				for ( i=clen/2; i; --i ) {
-					ipos -= cvt->rate_incr;
-					output -= 1;
-					*output=((Uint16 *)cvt->buf)[(int)ipos];
-				}
+#ifdef DEBUG_CONVERT
+	fprintf(stderr, "Converting audio rate * %4.4f\n", 1.0/cvt->rate_incr);
+#endif
+	table = get_sinc_table(cvt->rate_incr);
+	if (!table) {
+		/* More ratios in use than are kept */
+		table = own = malloc(sizeof(sinc_table));
+		if (own) build_sinc_table(own, cvt->rate_incr);
+	}
+	planes = frames ? malloc(channels * stride * sizeof(float)) : NULL;
+	if (table && planes) {
+		/* Split the channels, repeating the first and last frames */
+		for (c = 0; c < channels; c++) {
+			plane = planes + c * stride + SINC_PAD;
+			p = cvt->buf + c * bytes;
+			for (i = 0; i < frames; i++, p += frame) plane[i] = get_sample(p, format);
+			for (i = 1; i <= SINC_PAD; i++) {
+				plane[-i] = plane[0];
+				plane[frames - 1 + i] = plane[frames - 1];
+			}
+		}
+		out = (int)(frames / cvt->rate_incr);
+		step = (Uint64)(cvt->rate_incr * 4294967296.0 + 0.5);
+		pos = 0;
+		p = cvt->buf;
+		for (i = 0; i < out; i++, pos += step) {
+			row = table->coefs[(pos >> (32 - SINC_PHASE_BITS)) & (SINC_PHASES - 1)];
+			for (c = 0; c < channels; c++, p += bytes) {
+				plane = planes + c * stride + SINC_PAD + (int)(pos >> 32) - (SINC_TAPS / 2 - 1);
+				put_sample(p, format, sinc_dot(plane, row));
 			}
-			break;
 		}
+		cvt->len_cvt = out * frame;
 	}
-	cvt->len_cvt = clen;
+	free(planes);
+	free(own);
 	if ( cvt->filters[++cvt->filter_index] ) {
 		cvt->filters[cvt->filter_index](cvt, format);
 	}
-}*/
+}
+
+static void SDLCALL SDL_RateSinc (SDL1_AudioCVT *cvt, Uint16 format) {
+	rate_sinc(cvt, format, 1);
+}
+
+static void SDLCALL SDL_RateSinc_c2 (SDL1_AudioCVT *cvt, Uint16 format) {
+	rate_sinc(cvt, format, 2);
+}
+
+static void SDLCALL SDL_RateSinc_c4 (SDL1_AudioCVT *cvt, Uint16 format) {
+	rate_sinc(cvt, format, 4);
+}
+
+static void SDLCALL SDL_RateSinc_c6 (SDL1_AudioCVT *cvt, Uint16 format) {
+	rate_sinc(cvt, format, 6);
+}
+
+/* Fused conversion: rather than passing over the whole buffer once per
+ * filter, run the chain on blocks small enough to stay in cache, so the
+ * buffer is only read and written once. The chain is moved up one slot,
+ * behind SDL_ConvertFused.
+ */
+#define FUSED_SCRATCH 16384
+
+/* Run the chain on len bytes at src through the scratch buffer, placing
+ * the result at dst
+ */
+static int fused_block (SDL1_AudioCVT *cvt, Uint16 format, Uint8 *scratch,
+	int src, int len, int dst) {
+	SDL1_AudioCVT block = *cvt;
+	if ( len == 0 ) {
+		return 0;
+	}
+	memcpy(scratch, cvt->buf + src, len);
+	block.buf = scratch;
+	block.len_cvt = len;
+	block.filter_index = 1;
+	block.filters[1](&block, format);
+	memcpy(cvt->buf + dst, scratch, block.len_cvt);
+	return block.len_cvt;
+}
+
+static void SDLCALL SDL_ConvertFused (SDL1_AudioCVT *cvt, Uint16 format) {
+	Uint8 scratch[FUSED_SCRATCH];
+	/* Both are powers of two, so blocks hold whole frames even when the
+	 * rate is divided down, and all blocks give the same output length
+	 */
+	int in_len = FUSED_SCRATCH / cvt->len_mult;
+	int out_len = (int)(in_len * cvt->len_ratio);
+	int blocks = cvt->len_cvt / in_len;
+	int rest = cvt->len_cvt - blocks * in_len;
+	int i, b, len = 0;
+	for ( i = 0; i <= blocks; ++i ) {
+		/* Go backwards when growing, so the output never overtakes
+		 * the input
+		 */
+		b = (out_len > in_len) ? blocks - i : i;
+		len += fused_block(cvt, format, scratch, b * in_len,
+			(b < blocks) ? in_len : rest, b * out_len);
+	}
+	cvt->len_cvt = len;
+}
+
+/* Put SDL_ConvertFused in front of the filter chain where it gives the
+ * same results
+ */
+static void plan_fused (SDL1_AudioCVT *cvt, int src_channels, int dst_channels) {
+	const char *env = getenv("SDLCL_AUDIO_FUSED");
+	int i;
+	if (env && !strcmp(env, "0")) return;
+	/* A single filter is already one pass, and there must be room to
+	 * move the chain up
+	 */
+	if (cvt->filter_index < 2 || cvt->filter_index > 8) return;
+	/* The arbitrary ratio resampler doesn't split into blocks */
+	if (cvt->rate_incr != 0.0) return;
+	/* The surround and strip filters don't keep whole frames */
+	if (src_channels > 2 || dst_channels > 2) return;
+	/* Only worth it when later filters make several passes over data
+	 * much larger than the input
+	 */
+	if (cvt->len_mult < 8 || cvt->len_mult > FUSED_SCRATCH / CVT_SIMD_CHUNK) return;
+	for (i = cvt->filter_index; i > 0; i--) cvt->filters[i] = cvt->filters[i-1];
+	cvt->filters[0] = SDL_ConvertFused;
+	cvt->filter_index++;
+}
+
 
 DECLSPEC int SDLCALL SDL_ConvertAudio (SDL1_AudioCVT *cvt) {
 	/* Make sure there's data to convert */
@@ -1319,6 +1938,10 @@ DECLSPEC int SDLCALL SDL_BuildAudioCVT (SDL1_AudioCVT *cvt,
 	Uint16 dst_format, Uint8 dst_channels, int dst_rate) {
 /*printf("Build format %04x->%04x, channels %u->%u, rate %d->%d\n",
 		src_format, dst_format, src_channels, dst_channels, src_rate, dst_rate);*/
+	Uint8 in_channels = src_channels;
+
+	init_cvt_simd();
+
 	/* Start off with no conversion necessary */
 	cvt->needed = 0;
 	cvt->filter_index = 0;
@@ -1462,30 +2085,31 @@ DECLSPEC int SDLCALL SDL_BuildAudioCVT (SDL1_AudioCVT *cvt,
 			lo_rate *= 2;
 			cvt->len_ratio *= len_ratio;
 		}
-		/* We may need a slow conversion here to finish up */
+		/* Finish up with the arbitrary ratio resampler */
 		if ( (lo_rate/100) != (hi_rate/100) ) {
-#if 1
-			/* The problem with this is that if the input buffer is
-			   say 1K, and the conversion rate is say 1.1, then the
-			   output buffer is 1.1K, which may not be an acceptable
-			   buffer size for the audio driver (not a power of 2)
-			*/
-			/* For now, punt and hope the rate distortion isn't great.
-			*/
-#else
+			switch (src_channels) {
+				case 1: rate_cvt = SDL_RateSinc; break;
+				case 2: rate_cvt = SDL_RateSinc_c2; break;
+				case 4: rate_cvt = SDL_RateSinc_c4; break;
+				case 6: rate_cvt = SDL_RateSinc_c6; break;
+				default: return -1;
+			}
+			/* rate_incr is input frames per output frame */
 			if ( src_rate < dst_rate ) {
 				cvt->rate_incr = (double)lo_rate/hi_rate;
 				cvt->len_mult *= 2;
-				cvt->len_ratio /= cvt->rate_incr;
 			} else {
 				cvt->rate_incr = (double)hi_rate/lo_rate;
-				cvt->len_ratio *= cvt->rate_incr;
 			}
-			cvt->filters[cvt->filter_index++] = SDL_RateSLOW;
-#endif
+			cvt->len_ratio /= cvt->rate_incr;
+			get_sinc_table(cvt->rate_incr);
+			cvt->filters[cvt->filter_index++] = rate_cvt;
 		}
 	}
 
+	/* Do it all in one pass if possible */
+	plan_fused(cvt, in_channels, dst_channels);
+
 	/* Set up the filter information */
 	if ( cvt->filter_index != 0 ) {
 		cvt->needed = 1;
@@ -1497,3 +2121,249 @@ DECLSPEC int SDLCALL SDL_BuildAudioCVT (SDL1_AudioCVT *cvt,
 	}
 	return(cvt->needed);
 }
+
+/* Streaming conversion. Input is converted in chunks of at most
+ * STREAM_CHUNK frames as it is put into the stream: first to the
+ * destination format and channels with the filter chain, then to the
+ * destination rate with the windowed sinc filter, whose input history is
+ * kept between chunks. Everything is allocated when the stream is created,
+ * and the output queue has a fixed size, so putting stops accepting input
+ * until some output has been taken.
+ */
+#define STREAM_CHUNK 1024
+
+struct SDLCL_AudioStream {
+	SDL1_AudioCVT cvt;
+	Uint16 dst_format;
+	int dst_channels;
+	int src_frame;
+	int dst_frame;
+	Uint8 *work;           /* One chunk, plus room for the filter chain to grow it */
+	int pending;           /* Bytes of an incomplete input frame at the start of work */
+	/* Resampler, when the rates differ */
+	const sinc_table *table;
+	sinc_table *own;
+	double rate_incr;
+	Uint64 pos, step;      /* Position of the next window in planes, 32.32 fixed point */
+	float *planes;         /* Input history, one plane per channel */
+	int plane_size;
+	int frames;            /* Frames held in each plane */
+	int primed;            /* Whether the history has been started */
+	int padded;            /* Frames of padding added by SDLCL_AudioStreamFlush() */
+	/* Converted output waiting to be taken */
+	Uint8 *queue;
+	int queue_size;
+	int queue_head;
+	int queue_len;
+};
+
+DECLSPEC SDLCL_AudioStream * SDLCALL SDLCL_NewAudioStream (
+	Uint16 src_format, Uint8 src_channels, int src_rate,
+	Uint16 dst_format, Uint8 dst_channels, int dst_rate) {
+	SDLCL_AudioStream *stream;
+	int queue_frames = 2 * STREAM_CHUNK;
+	if (src_rate <= 0 || dst_rate <= 0 || !src_channels || !dst_channels) return NULL;
+	stream = calloc(1, sizeof(SDLCL_AudioStream));
+	if (!stream) return NULL;
+	/* Rates are handled by the stream itself */
+	if (SDL_BuildAudioCVT(&stream->cvt, src_format, src_channels, src_rate,
+		dst_format, dst_channels, src_rate) < 0) {
+		free(stream);
+		return NULL;
+	}
+	stream->dst_format = dst_format;
+	stream->dst_channels = dst_channels;
+	stream->src_frame = (src_format & 0xFF) / 8 * src_channels;
+	stream->dst_frame = (dst_format & 0xFF) / 8 * dst_channels;
+	stream->work = malloc(STREAM_CHUNK * stream->src_frame * stream->cvt.len_mult);
+	if ((src_rate/100) != (dst_rate/100)) {
+		stream->rate_incr = (double)src_rate / dst_rate;
+		stream->table = get_sinc_table(stream->rate_incr);
+		if (!stream->table) {
+			/* More ratios in use than are kept */
+			stream->table = stream->own = malloc(sizeof(sinc_table));
+			if (stream->own) build_sinc_table(stream->own, stream->rate_incr);
+		}
+		stream->step = (Uint64)(stream->rate_incr * 4294967296.0 + 0.5);
+		stream->plane_size = STREAM_CHUNK + 2 * SINC_TAPS;
+		stream->planes = malloc(dst_channels * stream->plane_size * sizeof(float));
+		queue_frames = 2 * ((int)(STREAM_CHUNK / stream->rate_incr) + SINC_TAPS);
+	}
+	stream->queue_size = queue_frames * stream->dst_frame;
+	stream->queue = malloc(stream->queue_size);
+	if (!stream->work || !stream->queue || (stream->rate_incr != 0.0 &&
+		(!stream->table || !stream->planes))) {
+		SDLCL_FreeAudioStream(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+DECLSPEC void SDLCALL SDLCL_FreeAudioStream (SDLCL_AudioStream *stream) {
+	if (!stream) return;
+	free(stream->queue);
+	free(stream->planes);
+	free(stream->own);
+	free(stream->work);
+	free(stream);
+}
+
+/* Make the free space in the queue contiguous, returning where it starts */
+static Uint8 *stream_tail (SDLCL_AudioStream *stream) {
+	if (stream->queue_head) {
+		memmove(stream->queue, stream->queue + stream->queue_head, stream->queue_len);
+		stream->queue_head = 0;
+	}
+	return stream->queue + stream->queue_len;
+}
+
+/* Number of input frames that can be put without overflowing the queue */
+static int stream_room (SDLCL_AudioStream *stream) {
+	int room = (stream->queue_size - stream->queue_len) / stream->dst_frame;
+	int planes;
+	if (stream->rate_incr == 0.0) return room;
+	/* Leave space for everything the resampler could produce from the
+	 * history it holds as well
+	 */
+	room = (int)((room - 1) * stream->rate_incr) - stream->frames - 1;
+	planes = stream->plane_size - stream->frames - SINC_TAPS;
+	return room < planes ? room : planes;
+}
+
+/* Produce all the output the history allows, then drop the frames that
+ * are no longer needed
+ */
+static void stream_resample (SDLCL_AudioStream *stream) {
+	const float *row;
+	Uint8 *p = stream_tail(stream);
+	int channels = stream->dst_channels;
+	int bytes = (stream->dst_format & 0xFF) / 8;
+	int end = stream->frames - stream->padded;
+	int room = (stream->queue_size - stream->queue_len) / stream->dst_frame;
+	int first, c;
+	while ((int)(stream->pos >> 32) + SINC_TAPS <= stream->frames && room > 0) {
+		first = (int)(stream->pos >> 32);
+		/* Stop at the last frame put before a flush */
+		if (stream->padded && first + SINC_TAPS / 2 - 1 >= end) break;
+		row = stream->table->coefs[(stream->pos >> (32 - SINC_PHASE_BITS)) & (SINC_PHASES - 1)];
+		for (c = 0; c < channels; c++, p += bytes) {
+			put_sample(p, stream->dst_format,
+				sinc_dot(stream->planes + c * stream->plane_size + first, row));
+		}
+		stream->queue_len += stream->dst_frame;
+		stream->pos += stream->step;
+		room--;
+	}
+	first = (int)(stream->pos >> 32);
+	if (first > stream->frames) first = stream->frames;
+	if (first) {
+		for (c = 0; c < channels; c++) {
+			memmove(stream->planes + c * stream->plane_size,
+				stream->planes + c * stream->plane_size + first,
+				(stream->frames - first) * sizeof(float));
+		}
+		stream->frames -= first;
+		stream->pos -= (Uint64)first << 32;
+	}
+}
+
+/* Add converted frames to the resampler's history */
+static void stream_history (SDLCL_AudioStream *stream, const Uint8 *src, int frames) {
+	int channels = stream->dst_channels;
+	int bytes = (stream->dst_format & 0xFF) / 8;
+	float *plane;
+	int i, c;
+	for (c = 0; c < channels; c++) {
+		plane = stream->planes + c * stream->plane_size;
+		/* Repeat the first frame before the start, as SDL_ConvertAudio() does */
+		if (!stream->primed) {
+			for (i = 0; i < SINC_TAPS / 2 - 1; i++) plane[i] = get_sample(src + c * bytes, stream->dst_format);
+		}
+		plane += stream->primed ? stream->frames : SINC_TAPS / 2 - 1;
+		for (i = 0; i < frames; i++) plane[i] = get_sample(src + i * stream->dst_frame + c * bytes, stream->dst_format);
+	}
+	if (!stream->primed) {
+		stream->frames = SINC_TAPS / 2 - 1;
+		stream->primed = 1;
+	}
+	stream->frames += frames;
+}
+
+DECLSPEC int SDLCALL SDLCL_AudioStreamPut (SDLCL_AudioStream *stream, const void *buf, int len) {
+	const Uint8 *src = buf;
+	int used = 0, frames, room, take;
+	if (!stream || !buf || len < 0 || stream->padded) return -1;
+	while (len > 0) {
+		frames = (stream->pending + len) / stream->src_frame;
+		if (frames == 0) {
+			/* Keep an incomplete frame for next time */
+			memcpy(stream->work + stream->pending, src, len);
+			stream->pending += len;
+			used += len;
+			break;
+		}
+		room = stream_room(stream);
+		if (frames > room) frames = room;
+		if (frames > STREAM_CHUNK) frames = STREAM_CHUNK;
+		if (frames <= 0) break;
+		take = frames * stream->src_frame - stream->pending;
+		memcpy(stream->work + stream->pending, src, take);
+		src += take;
+		len -= take;
+		used += take;
+		stream->pending = 0;
+		stream->cvt.buf = stream->work;
+		stream->cvt.len = frames * stream->src_frame;
+		SDL_ConvertAudio(&stream->cvt);
+		if (stream->rate_incr != 0.0) {
+			stream_history(stream, stream->work, stream->cvt.len_cvt / stream->dst_frame);
+			stream_resample(stream);
+		} else {
+			memcpy(stream_tail(stream), stream->work, stream->cvt.len_cvt);
+			stream->queue_len += stream->cvt.len_cvt;
+		}
+	}
+	return used;
+}
+
+DECLSPEC int SDLCALL SDLCL_AudioStreamGet (SDLCL_AudioStream *stream, void *buf, int len) {
+	if (!stream || !buf || len < 0) return -1;
+	if (len > stream->queue_len) len = stream->queue_len;
+	memcpy(buf, stream->queue + stream->queue_head, len);
+	stream->queue_head += len;
+	stream->queue_len -= len;
+	if (!stream->queue_len) stream->queue_head = 0;
+	return len;
+}
+
+DECLSPEC int SDLCALL SDLCL_AudioStreamAvailable (SDLCL_AudioStream *stream) {
+	return stream ? stream->queue_len : -1;
+}
+
+DECLSPEC int SDLCALL SDLCL_AudioStreamFlush (SDLCL_AudioStream *stream) {
+	float *plane;
+	int i, c;
+	if (!stream) return -1;
+	stream->pending = 0;
+	if (stream->rate_incr == 0.0 || !stream->primed) return 0;
+	if (!stream->padded) {
+		/* Repeat the last frame past the end, as SDL_ConvertAudio() does */
+		for (c = 0; c < stream->dst_channels; c++) {
+			plane = stream->planes + c * stream->plane_size + stream->frames;
+			for (i = 0; i < SINC_TAPS / 2; i++) plane[i] = plane[-1];
+		}
+		stream->frames += SINC_TAPS / 2;
+		stream->padded = SINC_TAPS / 2;
+	}
+	stream_resample(stream);
+	if ((int)(stream->pos >> 32) + SINC_TAPS / 2 - 1 < stream->frames - stream->padded) {
+		/* The queue filled up, so there is more to come */
+		return -1;
+	}
+	/* Start over with the next sound */
+	stream->frames = 0;
+	stream->primed = 0;
+	stream->padded = 0;
+	stream->pos = 0;
+	return 0;
+}
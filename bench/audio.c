@@ -0,0 +1,120 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Audio benchmarks: conversion chains built by SDL_BuildAudioCVT() and
+ * mixing. Each iteration converts 4096 sample frames, or a few megabytes
+ * for the large cases.
+ */
+
+#include "bench.h"
+
+#define FRAMES 4096
+#define LARGE_FRAMES (1 << 21)
+
+typedef struct audio_case {
+	SDL_AudioCVT cvt;
+	Uint8 *src;
+	int srclen;
+	Uint8 *mix;
+} audio_case;
+
+static int sample_size (Uint16 format) {
+	return (format & 0xFF) / 8;
+}
+
+static void convert (void *data, int iterations) {
+	audio_case *c = data;
+	while (iterations--) {
+		memcpy(c->cvt.buf, c->src, c->srclen);
+		c->cvt.len = c->srclen;
+		SDL_ConvertAudio(&c->cvt);
+	}
+}
+
+static void bench_convert (const char *name, int frames,
+	Uint16 src_format, Uint8 src_channels, int src_rate,
+	Uint16 dst_format, Uint8 dst_channels, int dst_rate) {
+	audio_case c;
+	int i;
+	if (SDL_BuildAudioCVT(&c.cvt, src_format, src_channels, src_rate, dst_format, dst_channels, dst_rate) < 0)
+		bench_fail("SDL_BuildAudioCVT");
+	c.srclen = frames * src_channels * sample_size(src_format);
+	c.src = malloc(c.srclen);
+	c.cvt.buf = malloc(c.srclen * c.cvt.len_mult);
+	if (!c.src || !c.cvt.buf) bench_fail("malloc");
+	for (i = 0; i < c.srclen; i++) c.src[i] = (Uint8)(i * 7 + (i >> 5));
+	bench_run(name, convert, &c);
+	free(c.cvt.buf);
+	free(c.src);
+}
+
+static void silence (void *userdata, Uint8 *stream, int len) {
+	(void)userdata;
+	memset(stream, 0, len);
+}
+
+static void mix (void *data, int iterations) {
+	audio_case *c = data;
+	while (iterations--) SDL_MixAudio(c->mix, c->src, c->srclen, SDL_MIX_MAXVOLUME / 2);
+}
+
+int main (int argc, char *argv[]) {
+	SDL_AudioSpec spec;
+	audio_case c;
+	(void)argc;
+	(void)argv;
+	if (SDL_Init(SDL_INIT_AUDIO) < 0) bench_fail("SDL_Init");
+	bench_convert("cvt_s16lsb_to_s16msb_stereo_44k", FRAMES, AUDIO_S16LSB, 2, 44100, AUDIO_S16MSB, 2, 44100);
+	bench_convert("cvt_u8_mono_22k_to_s16_stereo_44k", FRAMES, AUDIO_U8, 1, 22050, AUDIO_S16SYS, 2, 44100);
+	bench_convert("cvt_s16_stereo_44k_to_u8_mono_22k", FRAMES, AUDIO_S16SYS, 2, 44100, AUDIO_U8, 1, 22050);
+	bench_convert("cvt_s16_stereo_22k_to_44k", FRAMES, AUDIO_S16SYS, 2, 22050, AUDIO_S16SYS, 2, 44100);
+	bench_convert("cvt_s16_stereo_48k_to_44k", FRAMES, AUDIO_S16SYS, 2, 48000, AUDIO_S16SYS, 2, 44100);
+	bench_convert("cvt_s16_stereo_to_surround_44k", FRAMES, AUDIO_S16SYS, 2, 44100, AUDIO_S16SYS, 6, 44100);
+
+	/* Large buffers, with the fused converter and with the filter chain */
+	bench_convert("cvt_large_u8_mono_11k_to_s16_stereo_44k", LARGE_FRAMES, AUDIO_U8, 1, 11025, AUDIO_S16SYS, 2, 44100);
+	bench_convert("cvt_large_s16_mono_22k_to_s16_stereo_88k", LARGE_FRAMES, AUDIO_S16SYS, 1, 22050, AUDIO_S16SYS, 2, 88200);
+	setenv("SDLCL_AUDIO_FUSED", "0", 1);
+	bench_convert("cvt_large_u8_mono_11k_to_s16_stereo_44k_chain", LARGE_FRAMES, AUDIO_U8, 1, 11025, AUDIO_S16SYS, 2, 44100);
+	bench_convert("cvt_large_s16_mono_22k_to_s16_stereo_88k_chain", LARGE_FRAMES, AUDIO_S16SYS, 1, 22050, AUDIO_S16SYS, 2, 88200);
+	unsetenv("SDLCL_AUDIO_FUSED");
+
+	/* SDL_MixAudio() needs an open device for the format */
+	memset(&spec, 0, sizeof(spec));
+	spec.freq = 44100;
+	spec.format = AUDIO_S16SYS;
+	spec.channels = 2;
+	spec.samples = 1024;
+	spec.callback = silence;
+	if (SDL_OpenAudio(&spec, NULL) < 0) bench_fail("SDL_OpenAudio");
+	c.srclen = FRAMES * 4;
+	c.src = malloc(c.srclen);
+	c.mix = calloc(1, c.srclen);
+	if (!c.src || !c.mix) bench_fail("malloc");
+	memset(c.src, 0x35, c.srclen);
+	bench_run("mixaudio_s16_stereo", mix, &c);
+	free(c.mix);
+	free(c.src);
+	SDL_CloseAudio();
+	SDL_Quit();
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Helpers shared by the benchmark programs. Each benchmark is run with a
+ * doubling number of iterations until one run takes long enough to time,
+ * and reported as a tab-separated line:
+ *
+ *     <name> <iterations> <total ns> <ns per iteration> <Mpx/s>
+ *
+ * The last column is "-" for benchmarks that don't process a fixed number
+ * of pixels per iteration.
+ */
+
+#ifndef SDLCL_BENCH_H
+#define SDLCL_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "SDL.h"
+
+#define BENCH_MIN_NS 200000000.0
+
+typedef void (*bench_fn)(void *data, int iterations);
+
+static double bench_now (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_run_pixels (const char *name, bench_fn fn, void *data, double pixels) {
+	double start, elapsed;
+	int iterations = 1;
+	/* Warm up caches and any lazily built tables */
+	fn(data, 1);
+	for (;;) {
+		start = bench_now();
+		fn(data, iterations);
+		elapsed = bench_now() - start;
+		if (elapsed >= BENCH_MIN_NS || iterations >= (1 << 30)) break;
+		iterations *= 2;
+	}
+	printf("%s\t%d\t%.0f\t%.1f\t", name, iterations, elapsed, elapsed / iterations);
+	if (pixels > 0) printf("%.1f\n", pixels * iterations * 1e3 / elapsed);
+	else printf("-\n");
+	fflush(stdout);
+}
+
+static void bench_run (const char *name, bench_fn fn, void *data) {
+	bench_run_pixels(name, fn, data, 0);
+}
+
+static void bench_fail (const char *what) {
+	fprintf(stderr, "%s failed: %s\n", what, SDL_GetError());
+	exit(1);
+}
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Audio conversion matrix: runs SDL_ConvertAudio() over every pair of
+ * formats, mono and stereo, several rate changes, buffer lengths and
+ * buffer alignments, and prints a hash of each result:
+ *
+ *     <src format> <src channels> <src rate> <dst format> <dst channels>
+ *     <dst rate> <frames> <offset> <len_cvt> <hash>
+ *
+ * The SIMD level is picked once per process, so "make check" runs this
+ * once per SDLCL_SIMD level and compares the output against the scalar
+ * run. Each case is also converted with the fused converter turned off,
+ * and the program fails if that gives a different result or if anything
+ * is written past the end of the buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#define GUARD 64
+
+static const struct {
+	const char *name;
+	Uint16 format;
+} formats[] = {
+	{ "U8", AUDIO_U8 },
+	{ "S8", AUDIO_S8 },
+	{ "U16LSB", AUDIO_U16LSB },
+	{ "S16LSB", AUDIO_S16LSB },
+	{ "U16MSB", AUDIO_U16MSB },
+	{ "S16MSB", AUDIO_S16MSB }
+};
+
+/* Same rate, doubling, halving, by four, and arbitrary ratios */
+static const int rates[][2] = {
+	{ 44100, 44100 },
+	{ 22050, 44100 },
+	{ 44100, 22050 },
+	{ 11025, 44100 },
+	{ 44100, 11025 },
+	{ 22050, 48000 },
+	{ 48000, 44100 }
+};
+
+/* Lengths around the SIMD block sizes, and offsets that misalign the buffer.
+ * More than two channels isn't covered: the surround filters are scalar only.
+ */
+static const int frame_counts[] = { 1, 2, 3, 7, 16, 33, 255, 1024, 4097 };
+static const int offsets[] = { 0, 1, 3, 8 };
+
+#define COUNT(a) (int)(sizeof(a) / sizeof((a)[0]))
+
+static int sample_size (Uint16 format) {
+	return (format & 0xFF) / 8;
+}
+
+/* FNV-1a */
+static Uint32 hash (const Uint8 *data, int len) {
+	Uint32 h = 2166136261u;
+	while (len--) h = (h ^ *data++) * 16777619u;
+	return h;
+}
+
+/* Convert srclen bytes of src placed offset bytes into a fresh buffer,
+ * returning the hash of the result, or exiting on an overrun
+ */
+static Uint32 convert (SDL_AudioCVT *cvt, const Uint8 *src, int srclen, int offset) {
+	int size = srclen * cvt->len_mult;
+	Uint8 *mem = malloc(offset + size + GUARD);
+	Uint32 h;
+	int i, overrun = 0;
+	if (!mem) {
+		fprintf(stderr, "malloc failed\n");
+		exit(1);
+	}
+	memset(mem, 0xA5, offset + size + GUARD);
+	cvt->buf = mem + offset;
+	cvt->len = srclen;
+	memcpy(cvt->buf, src, srclen);
+	if (SDL_ConvertAudio(cvt) < 0) {
+		fprintf(stderr, "SDL_ConvertAudio failed: %s\n", SDL_GetError());
+		exit(1);
+	}
+	for (i = 0; i < offset; i++) {
+		if (mem[i] != 0xA5) overrun = 1;
+	}
+	for (i = offset + size; i < offset + size + GUARD; i++) {
+		if (mem[i] != 0xA5) overrun = 1;
+	}
+	if (overrun || cvt->len_cvt < 0 || cvt->len_cvt > size) {
+		fprintf(stderr, "conversion wrote outside its buffer\n");
+		exit(1);
+	}
+	h = hash(cvt->buf, cvt->len_cvt);
+	free(mem);
+	return h;
+}
+
+static int check (int sf, int sc, int sr, int df, int dc, int dr) {
+	SDL_AudioCVT fused, chain;
+	Uint8 *src;
+	Uint32 h, chain_h;
+	int chain_len;
+	int f, o, i, srclen, failed = 0;
+	unsetenv("SDLCL_AUDIO_FUSED");
+	if (SDL_BuildAudioCVT(&fused, formats[sf].format, sc, sr, formats[df].format, dc, dr) < 0) {
+		fprintf(stderr, "SDL_BuildAudioCVT failed: %s\n", SDL_GetError());
+		exit(1);
+	}
+	setenv("SDLCL_AUDIO_FUSED", "0", 1);
+	if (SDL_BuildAudioCVT(&chain, formats[sf].format, sc, sr, formats[df].format, dc, dr) < 0) {
+		fprintf(stderr, "SDL_BuildAudioCVT failed: %s\n", SDL_GetError());
+		exit(1);
+	}
+	for (f = 0; f < COUNT(frame_counts); f++) {
+		srclen = frame_counts[f] * sc * sample_size(formats[sf].format);
+		src = malloc(srclen);
+		if (!src) {
+			fprintf(stderr, "malloc failed\n");
+			exit(1);
+		}
+		/* Cover the extremes as well as noise */
+		for (i = 0; i < srclen; i++) src[i] = (Uint8)(i * 151 + (i >> 3) * 29);
+		src[0] = 0x00;
+		if (srclen > 1) src[srclen - 1] = 0xFF;
+		for (o = 0; o < COUNT(offsets); o++) {
+			h = convert(&fused, src, srclen, offsets[o]);
+			chain_h = convert(&chain, src, srclen, offsets[o]);
+			chain_len = chain.len_cvt;
+			printf("%s\t%d\t%d\t%s\t%d\t%d\t%d\t%d\t%d\t%08x\n",
+				formats[sf].name, sc, sr, formats[df].name, dc, dr,
+				frame_counts[f], offsets[o], fused.len_cvt, (unsigned)h);
+			if (h != chain_h || fused.len_cvt != chain_len) {
+				fprintf(stderr, "%s %d %d -> %s %d %d, %d frames at offset %d: "
+					"fused and chained conversions differ\n",
+					formats[sf].name, sc, sr, formats[df].name, dc, dr,
+					frame_counts[f], offsets[o]);
+				failed = 1;
+			}
+		}
+		free(src);
+	}
+	return failed;
+}
+
+int main (int argc, char *argv[]) {
+	int sf, df, sc, dc, r, failed = 0;
+	(void)argc;
+	(void)argv;
+	for (sf = 0; sf < COUNT(formats); sf++)
+		for (df = 0; df < COUNT(formats); df++)
+			for (sc = 1; sc <= 2; sc++)
+				for (dc = 1; dc <= 2; dc++)
+					for (r = 0; r < COUNT(rates); r++)
+						failed |= check(sf, sc, rates[r][0], df, dc, rates[r][1]);
+	unsetenv("SDLCL_AUDIO_FUSED");
+	return failed;
+}
@@ -0,0 +1,81 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Event benchmarks: queue throughput through SDL_PushEvent() and
+ * SDL_PeepEvents(), and polling an empty queue.
+ */
+
+#include "bench.h"
+
+#define BATCH 64
+
+static void push_peep (void *data, int iterations) {
+	SDL_Event events[BATCH];
+	int i;
+	(void)data;
+	memset(events, 0, sizeof(events));
+	while (iterations--) {
+		for (i = 0; i < BATCH; i++) {
+			events[i].type = SDL_USEREVENT;
+			events[i].user.code = i;
+			SDL_PushEvent(&events[i]);
+		}
+		if (SDL_PeepEvents(events, BATCH, SDL_GETEVENT, SDL_ALLEVENTS) != BATCH)
+			bench_fail("SDL_PeepEvents");
+	}
+}
+
+static void peep_masked (void *data, int iterations) {
+	SDL_Event events[BATCH];
+	int i;
+	(void)data;
+	memset(events, 0, sizeof(events));
+	while (iterations--) {
+		/* Interleave two types and take out only one of them */
+		for (i = 0; i < BATCH; i++) {
+			events[i].type = (i & 1) ? SDL_USEREVENT : SDL_USEREVENT + 1;
+			SDL_PushEvent(&events[i]);
+		}
+		SDL_PeepEvents(events, BATCH, SDL_GETEVENT, SDL_EVENTMASK(SDL_USEREVENT));
+		SDL_PeepEvents(events, BATCH, SDL_GETEVENT, SDL_ALLEVENTS);
+	}
+}
+
+static void poll_empty (void *data, int iterations) {
+	SDL_Event event;
+	(void)data;
+	while (iterations--) {
+		while (SDL_PollEvent(&event));
+	}
+}
+
+int main (int argc, char *argv[]) {
+	(void)argc;
+	(void)argv;
+	if (SDL_Init(SDL_INIT_VIDEO) < 0) bench_fail("SDL_Init");
+	if (!SDL_SetVideoMode(320, 240, 32, SDL_SWSURFACE)) bench_fail("SDL_SetVideoMode");
+	bench_run("push_peep_64", push_peep, NULL);
+	bench_run("push_peep_masked_64", peep_masked, NULL);
+	bench_run("poll_empty", poll_empty, NULL);
+	SDL_Quit();
+	return 0;
+}
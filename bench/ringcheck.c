@@ -0,0 +1,108 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Audio ring locking: with SDLCL_AUDIO_RING, closing the device or quitting
+ * audio while holding SDL_LockAudio() must not hang, and the lock must
+ * still keep the callback out once the device is opened again. If any
+ * step hangs, SIGALRM kills the program.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "SDL.h"
+
+static volatile int calls;
+
+static void fill (void *userdata, Uint8 *stream, int len) {
+	(void)userdata;
+	/* Applications often take the lock in the callback as well */
+	SDL_LockAudio();
+	memset(stream, 0, len);
+	calls++;
+	SDL_UnlockAudio();
+}
+
+static void fail (const char *what) {
+	fprintf(stderr, "%s\n", what);
+	exit(1);
+}
+
+static void wait_callback (void) {
+	int start = calls;
+	while (calls == start) SDL_Delay(1);
+}
+
+static void open_playing (void) {
+	SDL_AudioSpec spec;
+	memset(&spec, 0, sizeof(spec));
+	spec.freq = 44100;
+	spec.format = AUDIO_S16SYS;
+	spec.channels = 2;
+	spec.samples = 512;
+	spec.callback = fill;
+	if (SDL_OpenAudio(&spec, NULL) < 0) {
+		fprintf(stderr, "SDL_OpenAudio failed: %s\n", SDL_GetError());
+		exit(1);
+	}
+	SDL_PauseAudio(0);
+	wait_callback();
+}
+
+int main (int argc, char *argv[]) {
+	int n;
+	(void)argc;
+	(void)argv;
+	setenv("SDLCL_AUDIO_RING", "4", 1);
+	alarm(10);
+	if (SDL_Init(SDL_INIT_AUDIO) < 0) {
+		fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	/* Close with the lock held twice */
+	open_playing();
+	SDL_LockAudio();
+	SDL_LockAudio();
+	SDL_CloseAudio();
+	SDL_UnlockAudio();
+	SDL_UnlockAudio();
+
+	/* The lock keeps the callback out of a reopened device */
+	open_playing();
+	SDL_LockAudio();
+	n = calls;
+	SDL_Delay(50);
+	if (calls != n) fail("callback ran while the audio was locked");
+	SDL_UnlockAudio();
+	wait_callback();
+
+	/* Quit audio with the lock held */
+	SDL_LockAudio();
+	SDL_QuitSubSystem(SDL_INIT_AUDIO);
+	SDL_UnlockAudio();
+
+	SDL_Quit();
+	return 0;
+}
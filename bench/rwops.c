@@ -0,0 +1,120 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* RWops benchmarks: small reads from memory and from a file, and the
+ * endian helpers. Each iteration goes through 1 MiB of data.
+ */
+
+#include "bench.h"
+
+#define DATA_SIZE (1 << 20)
+
+typedef struct rwops_case {
+	Uint8 *data;
+	const char *path;
+} rwops_case;
+
+static void read_chunks (SDL_RWops *rw, int size) {
+	Uint8 buf[4096];
+	SDL_RWseek(rw, 0, RW_SEEK_SET);
+	while (SDL_RWread(rw, buf, size, 1) == 1);
+}
+
+static void mem_read_4 (void *data, int iterations) {
+	rwops_case *c = data;
+	SDL_RWops *rw = SDL_RWFromMem(c->data, DATA_SIZE);
+	while (iterations--) read_chunks(rw, 4);
+	SDL_RWclose(rw);
+}
+
+static void mem_read_le32 (void *data, int iterations) {
+	rwops_case *c = data;
+	SDL_RWops *rw = SDL_RWFromConstMem(c->data, DATA_SIZE);
+	Uint32 sum = 0;
+	int i;
+	while (iterations--) {
+		SDL_RWseek(rw, 0, RW_SEEK_SET);
+		for (i = 0; i < DATA_SIZE / 4; i++) sum += SDL_ReadLE32(rw);
+	}
+	SDL_RWclose(rw);
+	if (sum == 0x12345678) printf("#\n");
+}
+
+static void file_read (void *data, int iterations, int size) {
+	rwops_case *c = data;
+	SDL_RWops *rw = SDL_RWFromFile(c->path, "rb");
+	if (!rw) bench_fail("SDL_RWFromFile");
+	while (iterations--) read_chunks(rw, size);
+	SDL_RWclose(rw);
+}
+
+static void file_read_16 (void *data, int iterations) {
+	file_read(data, iterations, 16);
+}
+
+static void file_read_4096 (void *data, int iterations) {
+	file_read(data, iterations, 4096);
+}
+
+static void file_seek_read (void *data, int iterations) {
+	rwops_case *c = data;
+	SDL_RWops *rw = SDL_RWFromFile(c->path, "rb");
+	Uint8 buf[64];
+	unsigned int pos = 1;
+	int i;
+	if (!rw) bench_fail("SDL_RWFromFile");
+	while (iterations--) {
+		for (i = 0; i < 1024; i++) {
+			pos = pos * 1103515245 + 12345;
+			SDL_RWseek(rw, (pos >> 8) % (DATA_SIZE - sizeof(buf)), RW_SEEK_SET);
+			SDL_RWread(rw, buf, sizeof(buf), 1);
+		}
+	}
+	SDL_RWclose(rw);
+}
+
+int main (int argc, char *argv[]) {
+	rwops_case c;
+	FILE *f;
+	char path[] = "/tmp/sdlcl-bench-XXXXXX";
+	int fd, i;
+	(void)argc;
+	(void)argv;
+	if (SDL_Init(0) < 0) bench_fail("SDL_Init");
+	c.data = malloc(DATA_SIZE);
+	if (!c.data) bench_fail("malloc");
+	for (i = 0; i < DATA_SIZE; i++) c.data[i] = (Uint8)(i * 13 + (i >> 9));
+	fd = mkstemp(path);
+	if (fd < 0 || !(f = fdopen(fd, "wb"))) bench_fail("mkstemp");
+	fwrite(c.data, 1, DATA_SIZE, f);
+	fclose(f);
+	c.path = path;
+	bench_run("mem_read_4_1m", mem_read_4, &c);
+	bench_run("mem_readle32_1m", mem_read_le32, &c);
+	bench_run("file_read_16_1m", file_read_16, &c);
+	bench_run("file_read_4096_1m", file_read_4096, &c);
+	bench_run("file_seek_read_64_x1024", file_seek_read, &c);
+	remove(path);
+	free(c.data);
+	SDL_Quit();
+	return 0;
+}
@@ -0,0 +1,354 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Video benchmarks: screen updates, blits, fills, conversions, color
+ * mapping and stretching.
+ */
+
+#include "bench.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+#define SPRITES 100
+
+typedef struct video_case {
+	SDL_Surface *src;
+	SDL_Surface *dst;
+	SDL_PixelFormat *format;
+	SDL_Color colors[256];
+} video_case;
+
+static void init_video (void) {
+	if (SDL_Init(SDL_INIT_VIDEO) < 0) bench_fail("SDL_Init");
+}
+
+/* Fill a surface with reproducible noise */
+static void bench_noise (SDL_Surface *surface, unsigned int seed) {
+	Uint8 *row;
+	int x, y;
+	SDL_LockSurface(surface);
+	for (y = 0; y < surface->h; y++) {
+		row = (Uint8 *)surface->pixels + y * surface->pitch;
+		for (x = 0; x < surface->w * surface->format->BytesPerPixel; x++) {
+			seed = seed * 1103515245 + 12345;
+			row[x] = seed >> 16;
+		}
+	}
+	SDL_UnlockSurface(surface);
+}
+
+static void gray_palette (SDL_Color *colors, int shift) {
+	int i;
+	for (i = 0; i < 256; i++) {
+		colors[i].r = (Uint8)(i + shift);
+		colors[i].g = (Uint8)(i * 3 + shift);
+		colors[i].b = (Uint8)(255 - i);
+	}
+}
+
+static void flip (void *data, int iterations) {
+	video_case *c = data;
+	while (iterations--) SDL_Flip(c->dst);
+}
+
+static void flip_palette (void *data, int iterations) {
+	video_case *c = data;
+	int i = 0;
+	while (iterations--) {
+		gray_palette(c->colors, i++);
+		SDL_SetColors(c->dst, c->colors, 0, 256);
+		SDL_Flip(c->dst);
+	}
+}
+
+static void update_rects (void *data, int iterations) {
+	video_case *c = data;
+	SDL_Rect rects[16];
+	int i;
+	for (i = 0; i < 16; i++) {
+		rects[i].x = (i * 97) % (WIDTH - 32);
+		rects[i].y = (i * 61) % (HEIGHT - 32);
+		rects[i].w = rects[i].h = 32;
+	}
+	while (iterations--) SDL_UpdateRects(c->dst, 16, rects);
+}
+
+/* The screen upload kernels are picked once per process, so the Makefile
+ * runs these again with each SDLCL_SIMD level, passing its name as suffix.
+ */
+static void bench_screen (const char *suffix) {
+	static const int depths[] = { 8, 16, 32 };
+	video_case c;
+	char name[64];
+	int i;
+	for (i = 0; i < 3; i++) {
+		init_video();
+		c.dst = SDL_SetVideoMode(WIDTH, HEIGHT, depths[i], SDL_SWSURFACE);
+		if (!c.dst) bench_fail("SDL_SetVideoMode");
+		if (depths[i] == 8) {
+			gray_palette(c.colors, 0);
+			SDL_SetColors(c.dst, c.colors, 0, 256);
+		}
+		bench_noise(c.dst, 1);
+		snprintf(name, sizeof(name), "flip_%dbpp%s", depths[i], suffix);
+		bench_run_pixels(name, flip, &c, WIDTH * HEIGHT);
+		snprintf(name, sizeof(name), "updaterects_%dbpp%s", depths[i], suffix);
+		bench_run_pixels(name, update_rects, &c, 16 * 32 * 32);
+		if (depths[i] == 8) {
+			snprintf(name, sizeof(name), "flip_8bpp_palette_change%s", suffix);
+			bench_run_pixels(name, flip_palette, &c, WIDTH * HEIGHT);
+		}
+		SDL_Quit();
+	}
+}
+
+static void blit_sprites (void *data, int iterations) {
+	video_case *c = data;
+	SDL_Rect rect;
+	int i;
+	while (iterations--) {
+		for (i = 0; i < SPRITES; i++) {
+			rect.x = (i * 97) % (WIDTH - c->src->w);
+			rect.y = (i * 61) % (HEIGHT - c->src->h);
+			SDL_BlitSurface(c->src, NULL, c->dst, &rect);
+		}
+	}
+}
+
+static SDL_Surface *make_surface (int w, int h, int bpp, int alpha) {
+	SDL_Surface *surface;
+	if (alpha)
+		surface = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+	else if (bpp == 16)
+		surface = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 16, 0xF800, 0x07E0, 0x001F, 0);
+	else if (bpp == 24)
+		surface = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 24, 0xFF0000, 0x00FF00, 0x0000FF, 0);
+	else if (bpp == 32)
+		surface = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	else
+		surface = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 8, 0, 0, 0, 0);
+	if (!surface) bench_fail("SDL_CreateRGBSurface");
+	bench_noise(surface, w * h + bpp);
+	return surface;
+}
+
+static void bench_blits (void) {
+	static const int depths[] = { 16, 32 };
+	video_case c;
+	char name[64];
+	int i;
+	init_video();
+	for (i = 0; i < 2; i++) {
+		c.dst = make_surface(WIDTH, HEIGHT, depths[i], 0);
+		c.src = make_surface(64, 64, depths[i], 0);
+		snprintf(name, sizeof(name), "blit_opaque_%dbpp", depths[i]);
+		bench_run(name, blit_sprites, &c);
+		SDL_SetColorKey(c.src, SDL_SRCCOLORKEY, SDL_MapRGB(c.src->format, 0, 0, 0));
+		snprintf(name, sizeof(name), "blit_colorkey_%dbpp", depths[i]);
+		bench_run(name, blit_sprites, &c);
+		SDL_SetColorKey(c.src, SDL_SRCCOLORKEY | SDL_RLEACCEL, SDL_MapRGB(c.src->format, 0, 0, 0));
+		snprintf(name, sizeof(name), "blit_colorkey_rle_%dbpp", depths[i]);
+		bench_run(name, blit_sprites, &c);
+		SDL_SetColorKey(c.src, 0, 0);
+		SDL_SetAlpha(c.src, SDL_SRCALPHA, 128);
+		snprintf(name, sizeof(name), "blit_surface_alpha_%dbpp", depths[i]);
+		bench_run(name, blit_sprites, &c);
+		SDL_FreeSurface(c.src);
+		c.src = make_surface(64, 64, 32, 1);
+		snprintf(name, sizeof(name), "blit_pixel_alpha_%dbpp", depths[i]);
+		bench_run(name, blit_sprites, &c);
+		SDL_FreeSurface(c.src);
+		SDL_FreeSurface(c.dst);
+	}
+	SDL_Quit();
+}
+
+static void fill_screen (void *data, int iterations) {
+	video_case *c = data;
+	Uint32 color = SDL_MapRGB(c->dst->format, 12, 34, 56);
+	while (iterations--) SDL_FillRect(c->dst, NULL, color);
+}
+
+static void fill_small (void *data, int iterations) {
+	video_case *c = data;
+	Uint32 color = SDL_MapRGB(c->dst->format, 12, 34, 56);
+	SDL_Rect rect;
+	int i;
+	while (iterations--) {
+		for (i = 0; i < SPRITES; i++) {
+			rect.x = (i * 97) % (WIDTH - 16);
+			rect.y = (i * 61) % (HEIGHT - 16);
+			rect.w = rect.h = 16;
+			SDL_FillRect(c->dst, &rect, color);
+		}
+	}
+}
+
+static void bench_fills (void) {
+	static const int depths[] = { 8, 16, 32 };
+	video_case c;
+	char name[64];
+	int i;
+	init_video();
+	for (i = 0; i < 3; i++) {
+		c.dst = make_surface(WIDTH, HEIGHT, depths[i], 0);
+		snprintf(name, sizeof(name), "fill_full_%dbpp", depths[i]);
+		bench_run(name, fill_screen, &c);
+		snprintf(name, sizeof(name), "fill_small_%dbpp", depths[i]);
+		bench_run(name, fill_small, &c);
+		SDL_FreeSurface(c.dst);
+	}
+	SDL_Quit();
+}
+
+static void convert (void *data, int iterations) {
+	video_case *c = data;
+	SDL_Surface *surface;
+	while (iterations--) {
+		surface = SDL_ConvertSurface(c->src, c->format, SDL_SWSURFACE);
+		if (!surface) bench_fail("SDL_ConvertSurface");
+		SDL_FreeSurface(surface);
+	}
+}
+
+static void bench_conversions (void) {
+	static const int pairs[][2] = { { 8, 32 }, { 16, 32 }, { 24, 32 }, { 32, 16 }, { 32, 8 } };
+	video_case c;
+	SDL_Surface *target;
+	char name[64];
+	int i;
+	init_video();
+	for (i = 0; i < 5; i++) {
+		c.src = make_surface(256, 256, pairs[i][0], 0);
+		target = make_surface(1, 1, pairs[i][1], 0);
+		if (pairs[i][0] == 8) {
+			gray_palette(c.colors, 0);
+			SDL_SetColors(c.src, c.colors, 0, 256);
+		}
+		if (pairs[i][1] == 8) {
+			gray_palette(c.colors, 7);
+			SDL_SetColors(target, c.colors, 0, 256);
+		}
+		c.format = target->format;
+		snprintf(name, sizeof(name), "convert_%dbpp_to_%dbpp", pairs[i][0], pairs[i][1]);
+		bench_run(name, convert, &c);
+		SDL_FreeSurface(target);
+		SDL_FreeSurface(c.src);
+	}
+	SDL_Quit();
+}
+
+static void map_rgb (void *data, int iterations) {
+	video_case *c = data;
+	Uint32 sum = 0;
+	int i;
+	while (iterations--) {
+		for (i = 0; i < 4096; i++)
+			sum += SDL_MapRGB(c->format, (i * 37) & 0xFF, (i * 11) & 0xFF, i >> 4);
+	}
+	/* Keep the calls from being optimized out */
+	if (sum == 0x12345678) printf("#\n");
+}
+
+static void get_rgb (void *data, int iterations) {
+	video_case *c = data;
+	Uint8 r, g, b, sum = 0;
+	Uint32 i;
+	while (iterations--) {
+		for (i = 0; i < 4096; i++) {
+			SDL_GetRGB(i * 2654435761u, c->format, &r, &g, &b);
+			sum += r + g + b;
+		}
+	}
+	if (sum == 0x12) printf("#\n");
+}
+
+static void bench_colors (void) {
+	static const int depths[] = { 8, 16, 32 };
+	video_case c;
+	SDL_Surface *surface;
+	char name[64];
+	int i;
+	init_video();
+	for (i = 0; i < 3; i++) {
+		surface = make_surface(1, 1, depths[i], 0);
+		if (depths[i] == 8) {
+			gray_palette(c.colors, 0);
+			SDL_SetColors(surface, c.colors, 0, 256);
+		}
+		c.format = surface->format;
+		snprintf(name, sizeof(name), "maprgb_4096_%dbpp", depths[i]);
+		bench_run(name, map_rgb, &c);
+		snprintf(name, sizeof(name), "getrgb_4096_%dbpp", depths[i]);
+		bench_run(name, get_rgb, &c);
+		SDL_FreeSurface(surface);
+	}
+	SDL_Quit();
+}
+
+static void stretch (void *data, int iterations) {
+	video_case *c = data;
+	while (iterations--) SDL_SoftStretch(c->src, NULL, c->dst, NULL);
+}
+
+/* SDLCL_SOFTSTRETCH is read again after each SDL_Quit() */
+static void bench_stretch (void) {
+	static const char *const modes[] = { NULL, "nearest", "linear" };
+	static const int depths[] = { 16, 32 };
+	video_case c;
+	char name[64];
+	int i, j;
+	for (i = 0; i < 3; i++) {
+		if (modes[i]) setenv("SDLCL_SOFTSTRETCH", modes[i], 1);
+		else unsetenv("SDLCL_SOFTSTRETCH");
+		init_video();
+		for (j = 0; j < 2; j++) {
+			c.src = make_surface(WIDTH / 2, HEIGHT / 2, depths[j], 0);
+			c.dst = make_surface(WIDTH, HEIGHT, depths[j], 0);
+			snprintf(name, sizeof(name), "softstretch_2x_%dbpp_%s", depths[j], modes[i] ? modes[i] : "sdl2");
+			bench_run(name, stretch, &c);
+			SDL_FreeSurface(c.dst);
+			SDL_FreeSurface(c.src);
+		}
+		SDL_Quit();
+	}
+}
+
+/* With "screen" as argument, only the screen updates are run, named after
+ * the SDLCL_SIMD level in effect
+ */
+int main (int argc, char *argv[]) {
+	char suffix[32];
+	const char *simd = getenv("SDLCL_SIMD");
+	if (argc > 1 && !strcmp(argv[1], "screen")) {
+		snprintf(suffix, sizeof(suffix), "_simd_%s", simd ? simd : "auto");
+		bench_screen(suffix);
+		return 0;
+	}
+	bench_screen("");
+	bench_blits();
+	bench_fills();
+	bench_conversions();
+	bench_colors();
+	bench_stretch();
+	return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Screen update checks, using the counters from SDLCL_GetVideoStats().
+ * "make check" runs this with the plain upload path, with
+ * SDLCL_DIRTY_TILES and with SDLCL_PRESENT_THREAD.
+ *
+ * A physical palette change on an 8-bit screen recolors every pixel, so
+ * the next update must expand the whole screen through the new palette,
+ * however small its rectangle. The update after that is small again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+#include "../sdlcl.h"
+
+#define WIDTH 64
+#define HEIGHT 48
+#define FULL_BYTES ((Uint64)WIDTH * HEIGHT * 4)
+
+static void fail (const char *what) {
+	fprintf(stderr, "%s\n", what);
+	exit(1);
+}
+
+/* Updates may be uploaded by the presenter thread after they return, so
+ * wait up to a second for at least the given number of bytes
+ */
+static Uint64 wait_bytes (Uint64 bytes) {
+	SDLCL_VideoStats stats;
+	Uint32 start = SDL_GetTicks();
+	for (;;) {
+		SDLCL_GetVideoStats(&stats);
+		if (stats.bytes >= bytes || SDL_GetTicks() - start > 1000) return stats.bytes;
+		SDL_Delay(1);
+	}
+}
+
+static void set_colors (SDL_Surface *screen, int shift) {
+	SDL_Color colors[256];
+	int i;
+	for (i = 0; i < 256; i++) {
+		colors[i].r = (Uint8)(i + shift);
+		colors[i].g = (Uint8)(i * 3 + shift);
+		colors[i].b = (Uint8)(255 - i);
+	}
+	SDL_SetColors(screen, colors, 0, 256);
+}
+
+int main (int argc, char *argv[]) {
+	SDL_Surface *screen;
+	Uint64 bytes;
+	int y;
+	(void)argc;
+	(void)argv;
+	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+		fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
+		return 1;
+	}
+	screen = SDL_SetVideoMode(WIDTH, HEIGHT, 8, SDL_SWSURFACE);
+	if (!screen) {
+		fprintf(stderr, "SDL_SetVideoMode failed: %s\n", SDL_GetError());
+		return 1;
+	}
+	if (SDL_LockSurface(screen)) fail("SDL_LockSurface failed");
+	for (y = 0; y < HEIGHT; y++)
+		memset((Uint8 *)screen->pixels + y * screen->pitch, y * 5, WIDTH);
+	SDL_UnlockSurface(screen);
+	set_colors(screen, 0);
+	SDL_Flip(screen);
+	if (wait_bytes(FULL_BYTES) < FULL_BYTES) fail("the first flip wasn't uploaded");
+
+	SDLCL_ResetVideoStats();
+	set_colors(screen, 40);
+	SDL_UpdateRect(screen, 10, 10, 1, 1);
+	bytes = wait_bytes(FULL_BYTES);
+	if (bytes != FULL_BYTES) {
+		fprintf(stderr, "expanded %lu bytes after a palette change, expected %lu\n",
+			(unsigned long)bytes, (unsigned long)FULL_BYTES);
+		return 1;
+	}
+
+	SDLCL_ResetVideoStats();
+	SDL_UpdateRect(screen, 10, 10, 1, 1);
+	SDL_Delay(100);
+	if (wait_bytes(0) >= FULL_BYTES) fail("the update after a palette change was still widened");
+
+	SDL_Quit();
+	return 0;
+}
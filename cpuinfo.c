@@ -25,6 +25,7 @@
 #include <dlfcn.h>
 
 #include "SDL2.h"
+#include "cpuinfo.h"
 
 extern DECLSPEC SDL_bool SDLCALL SDL_HasRDTSC(void)
 {
@@ -67,3 +68,27 @@ extern DECLSPEC SDL_bool SDLCALL SDL_HasAltiVec(void)
 {
 	return rSDL_HasAltiVec();
 }
+
+/* Highest SIMD level the CPU supports, optionally capped by setting
+ * SDLCL_SIMD to "none", "sse2" or "avx2".
+ */
+int SDLCL_GetSIMDLevel(void)
+{
+	static int level = -1;
+	const char *env;
+	int cap = SDLCL_SIMD_AVX2;
+	if (level >= 0) return level;
+	env = getenv("SDLCL_SIMD");
+	if (env) {
+		if (!strcmp(env, "none")) cap = SDLCL_SIMD_NONE;
+		else if (!strcmp(env, "sse2")) cap = SDLCL_SIMD_SSE2;
+	}
+	level = SDLCL_SIMD_NONE;
+#ifdef SDLCL_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) level = SDLCL_SIMD_SSE2;
+	if (__builtin_cpu_supports("avx2")) level = SDLCL_SIMD_AVX2;
+#endif
+	if (level > cap) level = cap;
+	return level;
+}
@@ -0,0 +1,39 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef SDLCL_CPUINFO_H
+#define SDLCL_CPUINFO_H
+
+#include "SDL2.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define SDLCL_X86_SIMD
+#endif
+
+/* Instruction set levels usable by the internal SIMD kernels */
+#define SDLCL_SIMD_NONE 0
+#define SDLCL_SIMD_SSE2 1
+#define SDLCL_SIMD_AVX2 2
+
+extern int SDLCL_GetSIMDLevel(void);
+
+#endif
@@ -27,6 +27,7 @@
 static SDL1_Cursor *current_cursor = NULL;
 static SDL1_Cursor *default_cursor = NULL;
 static int cursor_showing = SDL1_ENABLE;
+int SDLCL_cursor_serial = 0;
 
 static void init_cursor (void);
 
@@ -34,6 +35,7 @@ DECLSPEC void SDLCALL SDL_SetCursor (SDL1_Cursor *cursor) {
 	if (cursor && cursor != current_cursor) {
 		rSDL_SetCursor(cursor->sdl2);
 		current_cursor = cursor;
+		SDLCL_cursor_serial++;
 	}
 	if (!default_cursor) init_cursor();
 }
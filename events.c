@@ -23,7 +23,9 @@
 #include <stdlib.h>
 
 #include "SDL2.h"
+#include "video.h"
 #include "events.h"
+#include "stats.h"
 
 static int unicode_enabled = 0;
 
@@ -282,11 +284,13 @@ void SDLCL_ProcessEvent (SDL1_Event *event) {
 DECLSPEC void SDLCALL SDL_PumpEvents (void) {
 	SDL1_Event event;
 	SDL_Event event2;
+	Uint64 start = SDLCL_StatStart();
 	if (!event_queue.lock) {
 		/* SDL_PumpEvents() is only supposed to be called from one thread, */
 		/* so initializing like this should be safe. */
 		event_queue.lock = rSDL_CreateMutex();
 	}
+	SDLCL_FlushScreen();
 	while (rSDL_PollEvent(&event2)) {
 		switch (event2.type) {
 			case SDL_WINDOWEVENT:
@@ -359,6 +363,8 @@ DECLSPEC void SDLCALL SDL_PumpEvents (void) {
 		}
 	}
 	flush_unicode();
+	SDLCL_StatEnd(SDLCL_STAT_PUMP, start);
+	SDLCL_DumpStats();
 }
 
 DECLSPEC int SDLCALL SDL_PollEvent (SDL1_Event *event) {
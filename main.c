@@ -27,6 +27,7 @@
 #include "video.h"
 #include "audio.h"
 #include "loadso.h"
+#include "stats.h"
 
 #define SDL1_INIT_TIMER       0x00000001
 #define SDL1_INIT_AUDIO       0x00000010
@@ -133,6 +134,7 @@ DECLSPEC int SDLCALL SDL_InitSubSystem (Uint32 flags) {
 DECLSPEC int SDLCALL SDL_Init (Uint32 flags) {
 	if (!lib) return -1;
 	if (rSDL_Init(0)) return -1;
+	SDLCL_InitStats();
 	return SDL_InitSubSystem(flags);
 }
 
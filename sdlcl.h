@@ -0,0 +1,172 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Extensions to the SDL 1.2 API provided by SDLCL.
+ * Include this after SDL.h.
+ */
+
+#ifndef SDLCL_H
+#define SDLCL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* SDLCL itself is built against the SDL 2.0 headers, where these names are
+ * taken, and defines them to its own SDL 1.2 types before including this.
+ */
+#ifndef SDLCL_PIXELFORMAT
+#define SDLCL_PIXELFORMAT SDL_PixelFormat
+#define SDLCL_SURFACE SDL_Surface
+#define SDLCL_RECT SDL_Rect
+#endif
+
+/* Counters for the paths taken when uploading the screen to the renderer */
+typedef struct SDLCL_VideoStats {
+	Uint32 rows;           /* Regions copied one row at a time */
+	Uint32 contiguous;     /* Regions copied with a single memcpy */
+	Uint32 streamed;       /* Regions copied with non-temporal stores */
+	Uint32 expanded;       /* 8-bit regions expanded through the palette */
+	Uint32 mapped;         /* Regions committed without a copy (SDLCL_ZEROCOPY) */
+	Uint32 tiles_uploaded; /* Changed tiles uploaded (SDLCL_DIRTY_TILES) */
+	Uint32 tiles_skipped;  /* Unchanged tiles skipped (SDLCL_DIRTY_TILES) */
+	Uint64 bytes;          /* Total bytes written to the texture */
+	Uint32 scale_frames;   /* OpenGL frames scaled to the window */
+	Uint64 scale_usec;     /* Microseconds spent issuing those frames (SDLCL_GL_SCALE) */
+} SDLCL_VideoStats;
+
+extern DECLSPEC void SDLCALL SDLCL_GetVideoStats (SDLCL_VideoStats *stats);
+extern DECLSPEC void SDLCALL SDLCL_ResetVideoStats (void);
+
+/* Counters for surface allocations. The hit counts are the allocations
+ * served from SDLCL's own pools.
+ */
+typedef struct SDLCL_AllocStats {
+	Uint32 proxy_allocs;   /* Surfaces created */
+	Uint32 proxy_hits;     /* Surfaces created without a call to malloc */
+	Uint32 surface_allocs; /* SDL_CreateRGBSurface() calls eligible for SDLCL_SURFACE_CACHE */
+	Uint32 surface_hits;   /* SDL_CreateRGBSurface() calls served from SDLCL_SURFACE_CACHE */
+} SDLCL_AllocStats;
+
+extern DECLSPEC void SDLCALL SDLCL_GetAllocStats (SDLCL_AllocStats *stats);
+
+/* Convert count pixels of the given format, packed at its BytesPerPixel,
+ * from or to packed RGBA8888 values (0xRRGGBBAA). Colors are matched to
+ * palettized formats the same way as SDL_MapRGBA. Return 0 on success.
+ */
+extern DECLSPEC int SDLCALL SDLCL_MapRGBAArray (const SDLCL_PIXELFORMAT *fmt, const Uint32 *rgba, void *pixels, int count);
+extern DECLSPEC int SDLCALL SDLCL_GetRGBAArray (const SDLCL_PIXELFORMAT *fmt, const void *pixels, Uint32 *rgba, int count);
+
+/* One blit of an SDLCL_BlitBatch() call. The rectangles work as they do
+ * for SDL_BlitSurface(), and dstrect is updated the same way.
+ */
+typedef struct SDLCL_BlitItem {
+	SDLCL_SURFACE *src;
+	SDLCL_RECT *srcrect;
+	SDLCL_RECT *dstrect;
+} SDLCL_BlitItem;
+
+/* Perform count blits onto dst in one call, in order. flags is reserved
+ * and should be 0. Returns 0 if every blit succeeded, or -1 if any failed.
+ */
+extern DECLSPEC int SDLCALL SDLCL_BlitBatch (SDLCL_SURFACE *dst, SDLCL_BlitItem *items, int count, Uint32 flags);
+
+/* Calls timed by SDLCL_GetStats() */
+enum {
+	SDLCL_STAT_FLIP,        /* SDL_Flip() */
+	SDLCL_STAT_UPDATERECTS, /* SDL_UpdateRect() and SDL_UpdateRects() */
+	SDLCL_STAT_GL_SWAP,     /* SDL_GL_SwapBuffers() */
+	SDLCL_STAT_BLIT,        /* SDL_UpperBlit(), SDL_LowerBlit() and SDLCL_BlitBatch() */
+	SDLCL_STAT_FILL,        /* SDL_FillRect() */
+	SDLCL_STAT_CONVERT,     /* SDL_ConvertSurface(), SDL_DisplayFormat() and SDL_DisplayFormatAlpha() */
+	SDLCL_STAT_PUMP,        /* SDL_PumpEvents() */
+	SDLCL_STAT_AUDIO,       /* The application's audio callback */
+	SDLCL_NUM_STATS
+};
+
+/* Timings of one kind of call. Percentiles are approximate, to within
+ * an eighth or so of their value.
+ */
+typedef struct SDLCL_CallStats {
+	Uint32 calls;
+	Uint64 total_ns;
+	Uint32 p50_ns;
+	Uint32 p90_ns;
+	Uint32 p99_ns;
+} SDLCL_CallStats;
+
+typedef struct SDLCL_Stats {
+	SDLCL_CallStats call[SDLCL_NUM_STATS];
+} SDLCL_Stats;
+
+/* Calls are only timed once enabled by this or by SDLCL_STATS. Returns
+ * whether they were being timed before.
+ */
+extern DECLSPEC int SDLCALL SDLCL_EnableStats (int enable);
+extern DECLSPEC void SDLCALL SDLCL_GetStats (SDLCL_Stats *stats);
+extern DECLSPEC void SDLCALL SDLCL_ResetStats (void);
+
+/* Converts audio incrementally, in chunks of any size. Conversions work as
+ * with SDL_BuildAudioCVT(), except that rates are always converted with a
+ * windowed sinc filter that carries its history from one chunk to the next.
+ * A stream must only be used by one thread at a time.
+ */
+typedef struct SDLCL_AudioStream SDLCL_AudioStream;
+
+extern DECLSPEC SDLCL_AudioStream * SDLCALL SDLCL_NewAudioStream (
+	Uint16 src_format, Uint8 src_channels, int src_rate,
+	Uint16 dst_format, Uint8 dst_channels, int dst_rate);
+extern DECLSPEC void SDLCALL SDLCL_FreeAudioStream (SDLCL_AudioStream *stream);
+
+/* Convert up to len bytes of input. Returns the number of bytes taken,
+ * which is less than len once the stream's output queue is full; take
+ * some output and put the rest again.
+ */
+extern DECLSPEC int SDLCALL SDLCL_AudioStreamPut (SDLCL_AudioStream *stream, const void *buf, int len);
+
+/* Take up to len bytes of converted output. Returns the number taken. */
+extern DECLSPEC int SDLCALL SDLCL_AudioStreamGet (SDLCL_AudioStream *stream, void *buf, int len);
+
+/* Number of bytes of output waiting to be taken */
+extern DECLSPEC int SDLCALL SDLCL_AudioStreamAvailable (SDLCL_AudioStream *stream);
+
+/* Convert what remains at the end of a sound, so the next sound starts
+ * afresh. Returns -1 if the output queue filled up first, in which case
+ * take some output and flush again before putting more input.
+ */
+extern DECLSPEC int SDLCALL SDLCL_AudioStreamFlush (SDLCL_AudioStream *stream);
+
+/* Counters for the ring-buffered audio callback (SDLCL_AUDIO_RING) */
+typedef struct SDLCL_AudioStats {
+	Uint32 periods;   /* Periods filled ahead of time by the application's callback */
+	Uint32 underruns; /* Device callbacks that found the ring empty and played silence */
+	Uint32 overruns;  /* Periods the application's callback took longer to fill than to play */
+} SDLCL_AudioStats;
+
+extern DECLSPEC void SDLCALL SDLCL_GetAudioStats (SDLCL_AudioStats *stats);
+extern DECLSPEC void SDLCALL SDLCL_ResetAudioStats (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
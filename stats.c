@@ -0,0 +1,197 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "SDL2.h"
+#include "stats.h"
+
+/* Call timings are kept per thread, in blocks that are pushed onto a list
+ * without locking the first time a thread records something. Readers add
+ * up all the blocks. Blocks of threads that exit stay on the list so their
+ * calls still count.
+ *
+ * Durations go into a histogram with four buckets per power of two
+ * nanoseconds, which puts percentiles within an eighth of their value.
+ */
+#define SUB_BITS 2
+#define NUM_BUCKETS ((32 - SUB_BITS + 1) << SUB_BITS)
+
+typedef struct stats_block {
+	struct stats_block *next;
+	Uint32 calls[SDLCL_NUM_STATS];
+	Uint64 total[SDLCL_NUM_STATS];
+	Uint32 buckets[SDLCL_NUM_STATS][NUM_BUCKETS];
+} stats_block;
+
+static const char *const stat_names[SDLCL_NUM_STATS] = {
+	"flip", "updaterects", "gl_swap", "blit", "fill", "convert", "pump", "audio"
+};
+
+int SDLCL_stats_enabled = 0;
+static Uint64 stats_freq = 1;
+static stats_block *stats_blocks = NULL;
+static __thread stats_block *thread_stats = NULL;
+/* Totals at the last SDLCL_ResetStats() */
+static stats_block baseline;
+static SDL_SpinLock baseline_lock = 0;
+static Uint32 dump_interval = 0;
+static Uint32 last_dump;
+
+static int bucket_index (Uint64 ns) {
+	Uint32 v = ns > 0xFFFFFFFF ? 0xFFFFFFFF : (Uint32)ns;
+	int order;
+	if (v < (1 << SUB_BITS)) return v;
+	order = 31 - __builtin_clz(v);
+	return ((order - SUB_BITS + 1) << SUB_BITS) + ((v >> (order - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+}
+
+/* The middle of the range of durations in a bucket */
+static Uint32 bucket_value (int index) {
+	int order, sub;
+	Uint32 lower, width;
+	if (index < (1 << SUB_BITS)) return index;
+	order = (index >> SUB_BITS) + SUB_BITS - 1;
+	sub = index & ((1 << SUB_BITS) - 1);
+	lower = (Uint32)((1 << SUB_BITS) + sub) << (order - SUB_BITS);
+	width = (Uint32)1 << (order - SUB_BITS);
+	return lower + width / 2;
+}
+
+static stats_block *new_block (void) {
+	stats_block *block = calloc(1, sizeof(stats_block));
+	if (!block) return NULL;
+	do {
+		block->next = stats_blocks;
+	} while (!rSDL_AtomicCASPtr((void **)&stats_blocks, block->next, block));
+	thread_stats = block;
+	return block;
+}
+
+void SDLCL_RecordStat (int stat, Uint64 start) {
+	stats_block *block = thread_stats;
+	Uint64 ns = (rSDL_GetPerformanceCounter() - start) * 1000000000 / stats_freq;
+	if (!block && !(block = new_block())) return;
+	block->calls[stat]++;
+	block->total[stat] += ns;
+	block->buckets[stat][bucket_index(ns)]++;
+}
+
+static void sum_blocks (stats_block *sum) {
+	const stats_block *block;
+	int i, j;
+	memset(sum, 0, sizeof(*sum));
+	for (block = stats_blocks; block; block = block->next) {
+		for (i = 0; i < SDLCL_NUM_STATS; i++) {
+			sum->calls[i] += block->calls[i];
+			sum->total[i] += block->total[i];
+			for (j = 0; j < NUM_BUCKETS; j++)
+				sum->buckets[i][j] += block->buckets[i][j];
+		}
+	}
+}
+
+static Uint32 percentile (const Uint32 *buckets, Uint32 calls, int percent) {
+	Uint32 seen = 0, rank = (Uint32)(((Uint64)calls * percent + 99) / 100);
+	int i;
+	if (!calls) return 0;
+	for (i = 0; i < NUM_BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen >= rank) return bucket_value(i);
+	}
+	return bucket_value(NUM_BUCKETS - 1);
+}
+
+DECLSPEC int SDLCALL SDLCL_EnableStats (int enable) {
+	int ret = SDLCL_stats_enabled;
+	stats_freq = rSDL_GetPerformanceFrequency();
+	SDLCL_stats_enabled = enable != 0;
+	return ret;
+}
+
+DECLSPEC void SDLCALL SDLCL_GetStats (SDLCL_Stats *stats) {
+	stats_block *sum;
+	int i, j;
+	memset(stats, 0, sizeof(*stats));
+	sum = malloc(sizeof(stats_block));
+	if (!sum) return;
+	sum_blocks(sum);
+	rSDL_AtomicLock(&baseline_lock);
+	for (i = 0; i < SDLCL_NUM_STATS; i++) {
+		sum->calls[i] -= baseline.calls[i];
+		sum->total[i] -= baseline.total[i];
+		for (j = 0; j < NUM_BUCKETS; j++)
+			sum->buckets[i][j] -= baseline.buckets[i][j];
+	}
+	rSDL_AtomicUnlock(&baseline_lock);
+	for (i = 0; i < SDLCL_NUM_STATS; i++) {
+		stats->call[i].calls = sum->calls[i];
+		stats->call[i].total_ns = sum->total[i];
+		stats->call[i].p50_ns = percentile(sum->buckets[i], sum->calls[i], 50);
+		stats->call[i].p90_ns = percentile(sum->buckets[i], sum->calls[i], 90);
+		stats->call[i].p99_ns = percentile(sum->buckets[i], sum->calls[i], 99);
+	}
+	free(sum);
+}
+
+DECLSPEC void SDLCALL SDLCL_ResetStats (void) {
+	stats_block *sum = malloc(sizeof(stats_block));
+	if (!sum) return;
+	sum_blocks(sum);
+	rSDL_AtomicLock(&baseline_lock);
+	memcpy(&baseline, sum, sizeof(baseline));
+	rSDL_AtomicUnlock(&baseline_lock);
+	free(sum);
+}
+
+/* With SDLCL_STATS set, calls are timed from the start. If it is set to a
+ * number of seconds, a summary is printed to stderr that often.
+ */
+void SDLCL_InitStats (void) {
+	const char *env = getenv("SDLCL_STATS");
+	if (!env) return;
+	SDLCL_EnableStats(1);
+	dump_interval = atoi(env) > 0 ? atoi(env) * 1000 : 0;
+	last_dump = rSDL_GetTicks();
+}
+
+/* Called from SDL_PumpEvents() */
+void SDLCL_DumpStats (void) {
+	SDLCL_Stats stats;
+	const SDLCL_CallStats *call;
+	Uint32 now;
+	int i;
+	if (!dump_interval) return;
+	now = rSDL_GetTicks();
+	if (now - last_dump < dump_interval) return;
+	last_dump = now;
+	SDLCL_GetStats(&stats);
+	for (i = 0; i < SDLCL_NUM_STATS; i++) {
+		call = &stats.call[i];
+		if (!call->calls) continue;
+		fprintf(stderr, "SDLCL: %-11s %8u calls, avg %8.1f us, p50 %8.1f us, p90 %8.1f us, p99 %8.1f us\n",
+			stat_names[i], call->calls, (double)call->total_ns / call->calls / 1000.0,
+			call->p50_ns / 1000.0, call->p90_ns / 1000.0, call->p99_ns / 1000.0);
+	}
+}
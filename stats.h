@@ -0,0 +1,43 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef SDLCL_STATS_H
+#define SDLCL_STATS_H
+
+#include "SDL2.h"
+#include "video.h"
+
+extern int SDLCL_stats_enabled;
+
+extern void SDLCL_InitStats (void);
+extern void SDLCL_RecordStat (int stat, Uint64 start);
+extern void SDLCL_DumpStats (void);
+
+/* Time a call with
+ *     Uint64 start = SDLCL_StatStart();
+ *     ...
+ *     SDLCL_StatEnd(SDLCL_STAT_..., start);
+ */
+#define SDLCL_StatStart() (SDLCL_stats_enabled ? rSDL_GetPerformanceCounter() : 0)
+#define SDLCL_StatEnd(stat, start) do { if (start) SDLCL_RecordStat(stat, start); } while (0)
+
+#endif
@@ -0,0 +1,446 @@
+/*
+ * SDLCL - SDL Compatibility Library
+ * Copyright (C) 2017 Alan Williams <mralert@gmail.com>
+ * 
+ * Portions taken from SDL 1.2.15
+ * Copyright (C) 1997-2012 Sam Latinga <slouken@libsdl.org>
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL2.h"
+#include "video.h"
+#include "cpuinfo.h"
+
+#ifdef SDLCL_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* SDL 2.0's SDL_SoftStretch() is nearest neighbor only and runs on one core.
+ * Setting SDLCL_SOFTSTRETCH to "nearest" or "linear" replaces it for 16 and
+ * 32-bit surfaces of the same format with one that splits the destination
+ * rows into bands for a pool of worker threads. SDLCL_STRETCH_THREADS sets
+ * the number of threads, by default one per CPU. Nearest neighbor sampling
+ * steps through the source the same way SDL 2.0 does.
+ */
+#define MAX_STRETCH_THREADS 16
+
+enum { STRETCH_SDL2, STRETCH_NEAREST, STRETCH_LINEAR };
+
+typedef struct {
+	const Uint8 *src;
+	int srcpitch, srcw, srch;
+	Uint8 *dst;
+	int dstpitch, dstw, dsth;
+	int bytespp;
+	int linear;
+	Uint32 spread; /* Channel layout for 16-bit linear filtering */
+	const int *xtab;
+	const Uint8 *wxtab;
+} stretch_job;
+
+static SDL_SpinLock stretch_init_lock = 0;
+static int stretch_mode = -1;
+static int stretch_nthreads;
+static SDL_Thread *stretch_threads[MAX_STRETCH_THREADS];
+static SDL_mutex *stretch_lock = NULL;
+static SDL_cond *stretch_start, *stretch_done;
+static const stretch_job *stretch_current;
+static int stretch_next_band, stretch_bands, stretch_pending;
+static int stretch_busy = 0; /* A job is using the workers */
+static unsigned int stretch_generation = 0;
+static int stretch_quit = 0;
+
+/* Nearest neighbor source positions, the same as SDL 2.0 uses */
+static int nearest_pos (int i, int srclen, int dstlen) {
+	return (int)(((Sint64)i * (((Sint64)srclen << 16) / dstlen)) >> 16);
+}
+
+/* Linear filter source positions in 24.8 fixed point, sampling at pixel
+ * centers and clamped to the source
+ */
+static int linear_pos (int i, int srclen, int dstlen) {
+	Sint64 pos = ((Sint64)(2 * i + 1) * srclen * 256) / (2 * dstlen) - 128;
+	if (pos < 0) pos = 0;
+	if (pos > (Sint64)(srclen - 1) * 256) pos = (Sint64)(srclen - 1) * 256;
+	return (int)pos;
+}
+
+static Uint32 lerp32 (Uint32 a, Uint32 b, int w) {
+	Uint32 rb = (((a & 0xFF00FF) * (256 - w) + (b & 0xFF00FF) * w) >> 8) & 0xFF00FF;
+	Uint32 ag = (((a >> 8) & 0xFF00FF) * (256 - w) + ((b >> 8) & 0xFF00FF) * w) & 0xFF00FF00;
+	return rb | ag;
+}
+
+/* 16-bit pixels are spread out with the middle channel moved to the upper
+ * half, so all three channels can be filtered in one 32-bit multiply
+ */
+static Uint16 lerp16 (Uint16 a, Uint16 b, int w, Uint32 spread) {
+	Uint32 sa = (a | ((Uint32)a << 16)) & spread;
+	Uint32 sb = (b | ((Uint32)b << 16)) & spread;
+	Uint32 s = ((sa * (32 - w) + sb * w) >> 5) & spread;
+	return s | (s >> 16);
+}
+
+static void nearest_row32_c (Uint32 *dst, const Uint32 *src, const int *xtab, int width) {
+	int i;
+	for (i = 0; i < width; i++) dst[i] = src[xtab[i]];
+}
+
+static void nearest_row16 (Uint16 *dst, const Uint16 *src, const int *xtab, int width) {
+	int i;
+	for (i = 0; i < width; i++) dst[i] = src[xtab[i]];
+}
+
+static void linear_row32_c (Uint32 *dst, const Uint32 *row0, const Uint32 *row1, const int *xtab, const Uint8 *wxtab, int wy, int srcw, int width) {
+	int i, x0, x1;
+	for (i = 0; i < width; i++) {
+		x0 = xtab[i];
+		x1 = x0 + (x0 < srcw - 1);
+		dst[i] = lerp32(lerp32(row0[x0], row0[x1], wxtab[i]), lerp32(row1[x0], row1[x1], wxtab[i]), wy);
+	}
+}
+
+static void linear_row16 (Uint16 *dst, const Uint16 *row0, const Uint16 *row1, const int *xtab, const Uint8 *wxtab, int wy, int srcw, int width, Uint32 spread) {
+	int i, x0, x1, wx;
+	wy >>= 3;
+	for (i = 0; i < width; i++) {
+		x0 = xtab[i];
+		x1 = x0 + (x0 < srcw - 1);
+		wx = wxtab[i] >> 3;
+		dst[i] = lerp16(lerp16(row0[x0], row0[x1], wx, spread), lerp16(row1[x0], row1[x1], wx, spread), wy, spread);
+	}
+}
+
+#ifdef SDLCL_X86_SIMD
+__attribute__((target("avx2")))
+static void nearest_row32_avx2 (Uint32 *dst, const Uint32 *src, const int *xtab, int width) {
+	__m256i index;
+	for (; width >= 8; width -= 8) {
+		index = _mm256_loadu_si256((const __m256i *)xtab);
+		_mm256_storeu_si256((__m256i *)dst, _mm256_i32gather_epi32((const int *)src, index, 4));
+		dst += 8;
+		xtab += 8;
+	}
+	nearest_row32_c(dst, src, xtab, width);
+}
+
+/* Filter the four channels of four pixels at once as 16-bit lanes */
+__attribute__((target("sse2")))
+static __m128i lerp32_sse2 (__m128i a, __m128i b, __m128i w, __m128i iw) {
+	const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+	__m128i rb = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(a, mask), iw), _mm_mullo_epi16(_mm_and_si128(b, mask), w));
+	__m128i ag = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(a, 8), mask), iw),
+		_mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 8), mask), w));
+	return _mm_or_si128(_mm_srli_epi16(rb, 8), _mm_andnot_si128(mask, ag));
+}
+
+__attribute__((target("sse2")))
+static void linear_row32_sse2 (Uint32 *dst, const Uint32 *row0, const Uint32 *row1, const int *xtab, const Uint8 *wxtab, int wy, int srcw, int width) {
+	const __m128i full = _mm_set1_epi16(256);
+	const __m128i vwy = _mm_set1_epi16(wy);
+	const __m128i viwy = _mm_set1_epi16(256 - wy);
+	__m128i a0, a1, b0, b1, w, iw;
+	int x0[4], x1[4], i;
+	for (; width >= 4; width -= 4) {
+		for (i = 0; i < 4; i++) {
+			x0[i] = xtab[i];
+			x1[i] = x0[i] + (x0[i] < srcw - 1);
+		}
+		a0 = _mm_setr_epi32(row0[x0[0]], row0[x0[1]], row0[x0[2]], row0[x0[3]]);
+		a1 = _mm_setr_epi32(row0[x1[0]], row0[x1[1]], row0[x1[2]], row0[x1[3]]);
+		b0 = _mm_setr_epi32(row1[x0[0]], row1[x0[1]], row1[x0[2]], row1[x0[3]]);
+		b1 = _mm_setr_epi32(row1[x1[0]], row1[x1[1]], row1[x1[2]], row1[x1[3]]);
+		w = _mm_setr_epi32(wxtab[0] * 0x10001, wxtab[1] * 0x10001, wxtab[2] * 0x10001, wxtab[3] * 0x10001);
+		iw = _mm_sub_epi16(full, w);
+		_mm_storeu_si128((__m128i *)dst, lerp32_sse2(lerp32_sse2(a0, a1, w, iw), lerp32_sse2(b0, b1, w, iw), vwy, viwy));
+		dst += 4;
+		xtab += 4;
+		wxtab += 4;
+	}
+	linear_row32_c(dst, row0, row1, xtab, wxtab, wy, srcw, width);
+}
+#endif
+
+static void stretch_band (const stretch_job *job, int y0, int y1) {
+	const Uint8 *row0, *row1;
+	Uint8 *dst;
+	int y, sy, wy;
+#ifdef SDLCL_X86_SIMD
+	int simd = SDLCL_GetSIMDLevel();
+#endif
+	for (y = y0; y < y1; y++) {
+		dst = job->dst + y * job->dstpitch;
+		if (!job->linear) {
+			row0 = job->src + nearest_pos(y, job->srch, job->dsth) * job->srcpitch;
+			if (job->bytespp == 2) {
+				nearest_row16((Uint16 *)dst, (const Uint16 *)row0, job->xtab, job->dstw);
+				continue;
+			}
+#ifdef SDLCL_X86_SIMD
+			if (simd >= SDLCL_SIMD_AVX2) {
+				nearest_row32_avx2((Uint32 *)dst, (const Uint32 *)row0, job->xtab, job->dstw);
+				continue;
+			}
+#endif
+			nearest_row32_c((Uint32 *)dst, (const Uint32 *)row0, job->xtab, job->dstw);
+			continue;
+		}
+		sy = linear_pos(y, job->srch, job->dsth);
+		wy = sy & 0xFF;
+		row0 = job->src + (sy >> 8) * job->srcpitch;
+		row1 = (sy >> 8) < job->srch - 1 ? row0 + job->srcpitch : row0;
+		if (job->bytespp == 2) {
+			linear_row16((Uint16 *)dst, (const Uint16 *)row0, (const Uint16 *)row1,
+				job->xtab, job->wxtab, wy, job->srcw, job->dstw, job->spread);
+			continue;
+		}
+#ifdef SDLCL_X86_SIMD
+		if (simd >= SDLCL_SIMD_SSE2) {
+			linear_row32_sse2((Uint32 *)dst, (const Uint32 *)row0, (const Uint32 *)row1,
+				job->xtab, job->wxtab, wy, job->srcw, job->dstw);
+			continue;
+		}
+#endif
+		linear_row32_c((Uint32 *)dst, (const Uint32 *)row0, (const Uint32 *)row1,
+			job->xtab, job->wxtab, wy, job->srcw, job->dstw);
+	}
+}
+
+/* Take bands of the current job until there are none left, called with
+ * stretch_lock held
+ */
+static void run_bands (void) {
+	const stretch_job *job = stretch_current;
+	int band;
+	while (stretch_next_band < stretch_bands) {
+		band = stretch_next_band++;
+		rSDL_UnlockMutex(stretch_lock);
+		stretch_band(job, job->dsth * band / stretch_bands, job->dsth * (band + 1) / stretch_bands);
+		rSDL_LockMutex(stretch_lock);
+		if (!--stretch_pending) rSDL_CondSignal(stretch_done);
+	}
+}
+
+static int stretch_worker (void *data) {
+	unsigned int generation;
+	(void)data;
+	rSDL_LockMutex(stretch_lock);
+	generation = stretch_generation;
+	while (!stretch_quit) {
+		if (generation == stretch_generation) {
+			rSDL_CondWait(stretch_start, stretch_lock);
+			continue;
+		}
+		generation = stretch_generation;
+		run_bands();
+	}
+	rSDL_UnlockMutex(stretch_lock);
+	return 0;
+}
+
+static void start_stretch_workers (void) {
+	const char *env = getenv("SDLCL_STRETCH_THREADS");
+	int n = env ? atoi(env) : rSDL_GetCPUCount();
+	if (n > MAX_STRETCH_THREADS) n = MAX_STRETCH_THREADS;
+	stretch_nthreads = 0;
+	if (n <= 1) return;
+	stretch_lock = rSDL_CreateMutex();
+	stretch_start = rSDL_CreateCond();
+	stretch_done = rSDL_CreateCond();
+	if (!stretch_lock || !stretch_start || !stretch_done) {
+		SDLCL_QuitStretch();
+		return;
+	}
+	stretch_quit = 0;
+	/* The calling thread works on a band as well */
+	for (stretch_nthreads = 0; stretch_nthreads < n - 1; stretch_nthreads++) {
+		stretch_threads[stretch_nthreads] = rSDL_CreateThread(stretch_worker, "SDLCL stretch", NULL);
+		if (!stretch_threads[stretch_nthreads]) break;
+	}
+}
+
+void SDLCL_QuitStretch (void) {
+	int i;
+	stretch_mode = -1;
+	if (stretch_lock) {
+		rSDL_LockMutex(stretch_lock);
+		stretch_quit = 1;
+		rSDL_CondBroadcast(stretch_start);
+		rSDL_UnlockMutex(stretch_lock);
+	}
+	for (i = 0; i < stretch_nthreads; i++) rSDL_WaitThread(stretch_threads[i], NULL);
+	stretch_nthreads = 0;
+	if (stretch_done) {
+		rSDL_DestroyCond(stretch_done);
+		stretch_done = NULL;
+	}
+	if (stretch_start) {
+		rSDL_DestroyCond(stretch_start);
+		stretch_start = NULL;
+	}
+	if (stretch_lock) {
+		rSDL_DestroyMutex(stretch_lock);
+		stretch_lock = NULL;
+	}
+}
+
+/* Safe to call from any thread, only the first call does anything */
+static void init_stretch (void) {
+	const char *env;
+	int mode = STRETCH_SDL2;
+	rSDL_AtomicLock(&stretch_init_lock);
+	if (stretch_mode < 0) {
+		env = getenv("SDLCL_SOFTSTRETCH");
+		if (env && !strcmp(env, "nearest")) mode = STRETCH_NEAREST;
+		else if (env && !strcmp(env, "linear")) mode = STRETCH_LINEAR;
+		if (mode != STRETCH_SDL2) start_stretch_workers();
+		stretch_mode = mode;
+	}
+	rSDL_AtomicUnlock(&stretch_init_lock);
+}
+
+static void run_stretch (const stretch_job *job) {
+	if (!stretch_nthreads || job->dsth < 2) {
+		stretch_band(job, 0, job->dsth);
+		return;
+	}
+	rSDL_LockMutex(stretch_lock);
+	if (stretch_busy) {
+		/* Another thread's job has the workers, do this one alone */
+		rSDL_UnlockMutex(stretch_lock);
+		stretch_band(job, 0, job->dsth);
+		return;
+	}
+	stretch_busy = 1;
+	stretch_current = job;
+	/* A few bands per thread to even out the load */
+	stretch_bands = (stretch_nthreads + 1) * 4;
+	if (stretch_bands > job->dsth) stretch_bands = job->dsth;
+	stretch_next_band = 0;
+	stretch_pending = stretch_bands;
+	stretch_generation++;
+	rSDL_CondBroadcast(stretch_start);
+	run_bands();
+	while (stretch_pending) rSDL_CondWait(stretch_done, stretch_lock);
+	stretch_busy = 0;
+	rSDL_UnlockMutex(stretch_lock);
+}
+
+static int valid_rect (const SDL_Rect *rect, const SDL1_Surface *surface) {
+	return rect->x >= 0 && rect->y >= 0 && rect->w > 0 && rect->h > 0 &&
+		rect->x + rect->w <= surface->w && rect->y + rect->h <= surface->h;
+}
+
+/* Returns -2 if the stretch should be left to SDL 2.0 */
+static int soft_stretch (SDL1_Surface *src, const SDL_Rect *srcrect, SDL1_Surface *dst, const SDL_Rect *dstrect) {
+	SDL1_PixelFormat *fmt = src->format;
+	stretch_job job;
+	int *xtab;
+	Uint8 *wxtab = NULL;
+	int i, pos;
+	if (src == dst || fmt->BytesPerPixel != dst->format->BytesPerPixel ||
+		(fmt->BytesPerPixel != 2 && fmt->BytesPerPixel != 4) ||
+		fmt->Rmask != dst->format->Rmask || fmt->Gmask != dst->format->Gmask ||
+		fmt->Bmask != dst->format->Bmask || fmt->Amask != dst->format->Amask ||
+		!valid_rect(srcrect, src) || !valid_rect(dstrect, dst)) return -2;
+	job.bytespp = fmt->BytesPerPixel;
+	job.linear = stretch_mode == STRETCH_LINEAR;
+	job.spread = 0;
+	if (job.linear && job.bytespp == 2) {
+		/* Only 5-6-5 and 5-5-5 layouts with green in the middle */
+		if (!fmt->Amask && fmt->Gmask == 0x07E0 && (fmt->Rmask | fmt->Bmask) == 0xF81F) job.spread = 0x07E0F81F;
+		else if (!fmt->Amask && fmt->Gmask == 0x03E0 && (fmt->Rmask | fmt->Bmask) == 0x7C1F) job.spread = 0x03E07C1F;
+		else job.linear = 0;
+	}
+	if (job.linear && job.bytespp == 4 && (fmt->Rloss || fmt->Gloss || fmt->Bloss || (fmt->Amask && fmt->Aloss)))
+		job.linear = 0;
+	xtab = malloc(dstrect->w * (sizeof(int) + 1));
+	if (!xtab) return -2;
+	if (job.linear) {
+		wxtab = (Uint8 *)(xtab + dstrect->w);
+		for (i = 0; i < dstrect->w; i++) {
+			pos = linear_pos(i, srcrect->w, dstrect->w);
+			xtab[i] = pos >> 8;
+			wxtab[i] = pos & 0xFF;
+		}
+	} else {
+		for (i = 0; i < dstrect->w; i++) xtab[i] = nearest_pos(i, srcrect->w, dstrect->w);
+	}
+	if (SDL_LockSurface(src) < 0) {
+		free(xtab);
+		return -1;
+	}
+	if (SDL_LockSurface(dst) < 0) {
+		SDL_UnlockSurface(src);
+		free(xtab);
+		return -1;
+	}
+	job.src = (const Uint8 *)src->pixels + srcrect->y * src->pitch + srcrect->x * job.bytespp;
+	job.srcpitch = src->pitch;
+	job.srcw = srcrect->w;
+	job.srch = srcrect->h;
+	job.dst = (Uint8 *)dst->pixels + dstrect->y * dst->pitch + dstrect->x * job.bytespp;
+	job.dstpitch = dst->pitch;
+	job.dstw = dstrect->w;
+	job.dsth = dstrect->h;
+	job.xtab = xtab;
+	job.wxtab = wxtab;
+	run_stretch(&job);
+	SDL_UnlockSurface(dst);
+	SDL_UnlockSurface(src);
+	free(xtab);
+	return 0;
+}
+
+DECLSPEC int SDL_SoftStretch (SDL1_Surface *src, SDL1_Rect *srcrect, SDL1_Surface *dst, SDL1_Rect *dstrect) {
+	SDL_Rect srcrect2, dstrect2;
+	SDL_Rect *srcptr = NULL;
+	SDL_Rect *dstptr = NULL;
+	int ret;
+	if (srcrect) {
+		srcrect2.x = srcrect->x;
+		srcrect2.y = srcrect->y;
+		srcrect2.w = srcrect->w;
+		srcrect2.h = srcrect->h;
+		srcptr = &srcrect2;
+	}
+	if (dstrect) {
+		dstrect2.x = dstrect->x;
+		dstrect2.y = dstrect->y;
+		dstrect2.w = dstrect->w;
+		dstrect2.h = dstrect->h;
+		dstptr = &dstrect2;
+	}
+	init_stretch();
+	if (stretch_mode != STRETCH_SDL2) {
+		if (!srcrect) {
+			srcrect2.x = srcrect2.y = 0;
+			srcrect2.w = src->w;
+			srcrect2.h = src->h;
+		}
+		if (!dstrect) {
+			dstrect2.x = dstrect2.y = 0;
+			dstrect2.w = dst->w;
+			dstrect2.h = dst->h;
+		}
+		ret = soft_stretch(src, &srcrect2, dst, &dstrect2);
+		if (ret != -2) return ret;
+	}
+	return rSDL_SoftStretch(src->sdl2_surface, srcptr, dst->sdl2_surface, dstptr);
+}
@@ -33,6 +33,8 @@ SDL2_SYMBOL(SDL_SetHint, SDL_bool, (const char *name, const char *value))
 
 /* Timer subsystem */
 SDL2_SYMBOL(SDL_GetTicks, Uint32, (void))
+SDL2_SYMBOL(SDL_GetPerformanceCounter, Uint64, (void))
+SDL2_SYMBOL(SDL_GetPerformanceFrequency, Uint64, (void))
 SDL2_SYMBOL(SDL_Delay, void, (Uint32 ms))
 SDL2_SYMBOL(SDL_AddTimer, SDL_TimerID, (Uint32 interval, SDL_TimerCallback callback, void *param))
 SDL2_SYMBOL(SDL_RemoveTimer, SDL_bool, (SDL_TimerID id))
@@ -60,6 +62,7 @@ SDL2_SYMBOL(SDL_SetSurfaceBlendMode, int, (SDL_Surface *surface, SDL_BlendMode b
 SDL2_SYMBOL(SDL_SetSurfaceAlphaMod, int, (SDL_Surface *surface, Uint8 alpha))
 SDL2_SYMBOL(SDL_SetColorKey, int, (SDL_Surface *surface, int flag, Uint32 key))
 SDL2_SYMBOL(SDL_SetSurfaceRLE, int, (SDL_Surface *surface, int flag))
+SDL2_SYMBOL(SDL_SetSurfacePalette, int, (SDL_Surface *surface, SDL_Palette *palette))
 SDL2_SYMBOL(SDL_GetClipRect, void, (SDL_Surface *surface, SDL_Rect *rect))
 SDL2_SYMBOL(SDL_SetClipRect, SDL_bool, (SDL_Surface *surface, const SDL_Rect *rect))
 SDL2_SYMBOL(SDL_FreeSurface, void, (SDL_Surface *surface))
@@ -97,10 +100,13 @@ SDL2_SYMBOL(SDL_MinimizeWindow, void, (SDL_Window *window))
 SDL2_SYMBOL(SDL_SetRelativeMouseMode, int, (SDL_bool enabled))
 
 SDL2_SYMBOL(SDL_CreateRenderer, SDL_Renderer *, (SDL_Window *window, int index, Uint32 flags))
+SDL2_SYMBOL(SDL_GetRendererInfo, int, (SDL_Renderer *renderer, SDL_RendererInfo *info))
 SDL2_SYMBOL(SDL_SetRenderDrawColor, int, (SDL_Renderer *renderer, Uint8 r, Uint8 g, Uint8 b, Uint8 a))
 SDL2_SYMBOL(SDL_RenderClear, int, (SDL_Renderer *))
 SDL2_SYMBOL(SDL_RenderCopy, int, (SDL_Renderer *renderer, SDL_Texture *texture, const SDL_Rect *srcrect, const SDL_Rect *dstrect))
 SDL2_SYMBOL(SDL_RenderPresent, void, (SDL_Renderer *renderer))
+SDL2_SYMBOL(SDL_RenderTargetSupported, SDL_bool, (SDL_Renderer *renderer))
+SDL2_SYMBOL(SDL_SetRenderTarget, int, (SDL_Renderer *renderer, SDL_Texture *texture))
 SDL2_SYMBOL(SDL_DestroyRenderer, void, (SDL_Renderer *renderer))
 SDL2_SYMBOL(SDL_CreateTexture, SDL_Texture *, (SDL_Renderer *renderer, Uint32 format, int access, int w, int h))
 SDL2_SYMBOL(SDL_SetTextureBlendMode, int, (SDL_Texture *texture, SDL_BlendMode blendMode))
@@ -118,6 +124,7 @@ SDL2_SYMBOL(SDL_GL_GetAttribute, int, (SDL_GLattr attr, int *value))
 SDL2_SYMBOL(SDL_GL_CreateContext, SDL_GLContext, (SDL_Window *window))
 SDL2_SYMBOL(SDL_GL_MakeCurrent, int, (SDL_Window *window, SDL_GLContext context))
 SDL2_SYMBOL(SDL_GL_DeleteContext, void, (SDL_GLContext context))
+SDL2_SYMBOL(SDL_GL_ExtensionSupported, SDL_bool, (const char *extension))
 
 SDL2_SYMBOL(SDL_GetWindowWMInfo, SDL_bool, (SDL_Window *window, SDL_SysWMinfo *info))
 
@@ -222,7 +229,13 @@ SDL2_SYMBOL(SDL_CondWait, int, (SDL_cond *cond, SDL_mutex *mutex))
 SDL2_SYMBOL(SDL_CondWaitTimeout, int, (SDL_cond *cond, SDL_mutex *mutex, Uint32 ms))
 SDL2_SYMBOL(SDL_DestroyCond, int, (SDL_cond *cond))
 
+SDL2_SYMBOL(SDL_AtomicLock, void, (SDL_SpinLock *lock))
+SDL2_SYMBOL(SDL_AtomicUnlock, void, (SDL_SpinLock *lock))
+SDL2_SYMBOL(SDL_AtomicCAS, SDL_bool, (SDL_atomic_t *a, int oldval, int newval))
+SDL2_SYMBOL(SDL_AtomicCASPtr, SDL_bool, (void **a, void *oldval, void *newval))
+
 /* CPU capabilities */
+SDL2_SYMBOL(SDL_GetCPUCount, int, (void))
 SDL2_SYMBOL(SDL_Has3DNow, SDL_bool, (void))
 SDL2_SYMBOL(SDL_HasAltiVec, SDL_bool, (void))
 SDL2_SYMBOL(SDL_HasMMX, SDL_bool, (void))
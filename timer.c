@@ -23,6 +23,7 @@
 #include <stdint.h>
 
 #include "SDL2.h"
+#include "video.h"
 
 int SDLCALL SDLCL_TimerInit (void) {
 	return rSDL_InitSubSystem(SDL_INIT_TIMER);
@@ -37,6 +38,13 @@ DECLSPEC Uint32 SDLCALL SDL_GetTicks (void) {
 }
 
 DECLSPEC void SDLCALL SDL_Delay (Uint32 ms) {
+	/* Wake up to present deferred screen updates when they are due */
+	Uint32 due = SDLCL_FlushDueScreen();
+	if (due && due < ms) {
+		rSDL_Delay(due);
+		SDLCL_FlushDueScreen();
+		ms -= due;
+	}
 	rSDL_Delay(ms);
 }
 
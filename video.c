@@ -31,6 +31,12 @@
 #include "rwops.h"
 #include "version.h"
 #include "loadso.h"
+#include "cpuinfo.h"
+#include "stats.h"
+
+#ifdef SDLCL_X86_SIMD
+#include <immintrin.h>
+#endif
 
 /* TODO: Proper initialization */
 DECLSPEC int SDLCALL SDL_VideoInit (const char *driver_name, Uint32 flags) {
@@ -39,15 +45,33 @@ DECLSPEC int SDLCALL SDL_VideoInit (const char *driver_name, Uint32 flags) {
 }
 
 static void close_window (void);
+static void init_defer (void);
+static int start_present_thread (int width, int height);
+static void stop_present_thread (void);
+static void drain_surface_cache (void);
 
 DECLSPEC void SDLCALL SDL_VideoQuit (void) {
 	close_window();
+	SDLCL_QuitStretch();
+	drain_surface_cache();
 	rSDL_VideoQuit();
 }
 
+/* The blit state last set on an SDL 2.0 surface, -1 where unknown */
+typedef struct blit_state {
+	int rle;
+	int blend;
+	int alphamod;
+	int keyed;
+	Uint32 key;
+} blit_state;
+
 typedef struct SDL1_Proxy {
 	SDL1_Surface surface;
 	SDL1_PixelFormat format;
+	blit_state blit;
+	int pool_class;
+	struct SDL1_Proxy *next_free;
 	SDL1_Palette palette;
 	SDL1_Color colors[1];
 } SDL1_Proxy;
@@ -107,12 +131,149 @@ static void process_masks (SDL1_PixelFormat *format) {
 	format->Ashift = masktoshift(format->Amask);
 }
 
+/* Freed proxies are kept on free lists by palette size instead of going
+ * back to malloc, since some applications create and free many temporary
+ * surfaces every frame. With SDLCL_SURFACE_CACHE set to a number, up to
+ * that many freed SDL 2.0 surfaces without a palette are also kept, and
+ * SDL_CreateRGBSurface() hands them out again for the same size and format.
+ */
+#define PROXY_POOL_CLASSES 2
+#define PROXY_POOL_MAX 64
+#define SURFACE_CACHE_MAX 64
+
+static SDL_SpinLock pool_lock = 0;
+static SDL1_Proxy *proxy_pool[PROXY_POOL_CLASSES];
+static int proxy_pool_size[PROXY_POOL_CLASSES];
+static SDL_Surface *surface_cache[SURFACE_CACHE_MAX];
+static int surface_cache_size = 0;
+static int surface_cache_limit = -1;
+static SDLCL_AllocStats alloc_stats;
+
+DECLSPEC void SDLCALL SDLCL_GetAllocStats (SDLCL_AllocStats *stats) {
+	rSDL_AtomicLock(&pool_lock);
+	*stats = alloc_stats;
+	rSDL_AtomicUnlock(&pool_lock);
+}
+
+static SDL1_Proxy *alloc_proxy (int ncolors) {
+	static const int class_colors[PROXY_POOL_CLASSES] = { 0, 256 };
+	SDL1_Proxy *proxy = NULL;
+	int pool_class;
+	for (pool_class = 0; pool_class < PROXY_POOL_CLASSES; pool_class++)
+		if (ncolors <= class_colors[pool_class]) break;
+	if (pool_class == PROXY_POOL_CLASSES) {
+		proxy = malloc(sizeof(SDL1_Proxy) + ncolors * sizeof(SDL1_Color));
+		if (proxy) proxy->pool_class = -1;
+		return proxy;
+	}
+	rSDL_AtomicLock(&pool_lock);
+	alloc_stats.proxy_allocs++;
+	if (proxy_pool[pool_class]) {
+		proxy = proxy_pool[pool_class];
+		proxy_pool[pool_class] = proxy->next_free;
+		proxy_pool_size[pool_class]--;
+		alloc_stats.proxy_hits++;
+	}
+	rSDL_AtomicUnlock(&pool_lock);
+	if (!proxy) {
+		proxy = malloc(sizeof(SDL1_Proxy) + class_colors[pool_class] * sizeof(SDL1_Color));
+		if (proxy) proxy->pool_class = pool_class;
+	}
+	return proxy;
+}
+
+static void free_proxy (SDL1_Proxy *proxy) {
+	int pool_class = proxy->pool_class;
+	if (pool_class >= 0) {
+		rSDL_AtomicLock(&pool_lock);
+		if (proxy_pool_size[pool_class] < PROXY_POOL_MAX) {
+			proxy->next_free = proxy_pool[pool_class];
+			proxy_pool[pool_class] = proxy;
+			proxy_pool_size[pool_class]++;
+			proxy = NULL;
+		}
+		rSDL_AtomicUnlock(&pool_lock);
+	}
+	free(proxy);
+}
+
+static int get_surface_cache_limit (void) {
+	const char *env;
+	int limit;
+	if (surface_cache_limit < 0) {
+		env = getenv("SDLCL_SURFACE_CACHE");
+		limit = env ? atoi(env) : 0;
+		if (limit < 0) limit = 0;
+		if (limit > SURFACE_CACHE_MAX) limit = SURFACE_CACHE_MAX;
+		surface_cache_limit = limit;
+	}
+	return surface_cache_limit;
+}
+
+/* Take a cached surface matching a new SDL_CreateRGBSurface() request and
+ * return it to the state of a freshly created one
+ */
+static SDL_Surface *reuse_surface (int width, int height, int depth, Uint32 Rmask, Uint32 Gmask, Uint32 Bmask, Uint32 Amask) {
+	SDL_Surface *surface2 = NULL;
+	SDL_PixelFormat *fmt;
+	int i;
+	if (!get_surface_cache_limit() || depth <= 8) return NULL;
+	rSDL_AtomicLock(&pool_lock);
+	alloc_stats.surface_allocs++;
+	for (i = surface_cache_size - 1; i >= 0; i--) {
+		fmt = surface_cache[i]->format;
+		if (surface_cache[i]->w == width && surface_cache[i]->h == height &&
+			fmt->BitsPerPixel == depth && fmt->Rmask == Rmask && fmt->Gmask == Gmask &&
+			fmt->Bmask == Bmask && fmt->Amask == Amask) {
+			surface2 = surface_cache[i];
+			surface_cache[i] = surface_cache[--surface_cache_size];
+			alloc_stats.surface_hits++;
+			break;
+		}
+	}
+	rSDL_AtomicUnlock(&pool_lock);
+	if (!surface2) return NULL;
+	memset(surface2->pixels, 0, surface2->pitch * surface2->h);
+	rSDL_SetClipRect(surface2, NULL);
+	rSDL_SetSurfaceRLE(surface2, 0);
+	rSDL_SetColorKey(surface2, SDL_FALSE, 0);
+	rSDL_SetSurfaceAlphaMod(surface2, 255);
+	rSDL_SetSurfaceBlendMode(surface2, Amask ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
+	return surface2;
+}
+
+/* Keep a surface for reuse, returns 0 if it was not kept */
+static int cache_surface (SDL_Surface *surface2) {
+	int kept = 0;
+	if (!get_surface_cache_limit() || surface2->format->palette || surface2->refcount != 1 ||
+		(surface2->flags & (SDL_PREALLOC | SDL_RLEACCEL)) || surface2->locked) return 0;
+	rSDL_AtomicLock(&pool_lock);
+	if (surface_cache_size < surface_cache_limit) {
+		surface_cache[surface_cache_size++] = surface2;
+		kept = 1;
+	}
+	rSDL_AtomicUnlock(&pool_lock);
+	return kept;
+}
+
+/* Free every cached surface, they would otherwise leak across SDL_Quit() */
+static void drain_surface_cache (void) {
+	SDL_Surface *drained[SURFACE_CACHE_MAX];
+	int i, count;
+	rSDL_AtomicLock(&pool_lock);
+	count = surface_cache_size;
+	memcpy(drained, surface_cache, count * sizeof(SDL_Surface *));
+	surface_cache_size = 0;
+	rSDL_AtomicUnlock(&pool_lock);
+	for (i = 0; i < count; i++) rSDL_FreeSurface(drained[i]);
+}
+
 static SDL1_Surface *SDLCL_CreateSurfaceFromSDL2(SDL_Surface *surface2) {
 	SDL1_Proxy *proxy;
 	int i, ncolors = surface2->format->palette ? surface2->format->palette->ncolors : 0;
 	SDL_Color *color;
 	SDL_BlendMode blend;
-	proxy = malloc(sizeof(SDL1_Proxy) + ncolors * sizeof(SDL1_Color));
+	proxy = alloc_proxy(ncolors);
 	if (!proxy) {
 		return NULL;
 	}
@@ -148,25 +309,54 @@ static SDL1_Surface *SDLCL_CreateSurfaceFromSDL2(SDL_Surface *surface2) {
 	proxy->format.Bmask = surface2->format->Bmask;
 	proxy->format.Amask = surface2->format->Amask;
 	process_masks(&proxy->format);
-	if (rSDL_GetColorKey(surface2, &proxy->format.colorkey))
+	proxy->blit.rle = -1;
+	proxy->blit.key = 0;
+	if (rSDL_GetColorKey(surface2, &proxy->format.colorkey)) {
 		proxy->format.colorkey = 0;
-	else
+		proxy->blit.keyed = 0;
+	} else {
 		proxy->surface.flags |= SDL1_SRCCOLORKEY;
-	if (rSDL_GetSurfaceAlphaMod(surface2, &proxy->format.alpha))
+		proxy->blit.keyed = 1;
+		proxy->blit.key = proxy->format.colorkey;
+	}
+	if (rSDL_GetSurfaceAlphaMod(surface2, &proxy->format.alpha)) {
 		proxy->format.alpha = 255;
-	if (!rSDL_GetSurfaceBlendMode(surface2, &blend) && blend == SDL_BLENDMODE_BLEND)
-		proxy->surface.flags |= SDL1_SRCALPHA;
+		proxy->blit.alphamod = -1;
+	} else {
+		proxy->blit.alphamod = proxy->format.alpha;
+	}
+	if (rSDL_GetSurfaceBlendMode(surface2, &blend)) {
+		proxy->blit.blend = -1;
+	} else {
+		if (blend == SDL_BLENDMODE_BLEND) proxy->surface.flags |= SDL1_SRCALPHA;
+		proxy->blit.blend = blend;
+	}
 	return &proxy->surface;
 }
 
+/* Only call the SDL 2.0 setters for state that actually changes, since
+ * they invalidate the blit mapping and may cause RLE encoding to be redone
+ */
+static void apply_blit_state (SDL_Surface *surface2, blit_state *cur, const blit_state *want) {
+	if (cur->rle != want->rle) rSDL_SetSurfaceRLE(surface2, want->rle);
+	if (cur->blend != want->blend) rSDL_SetSurfaceBlendMode(surface2, want->blend);
+	if (cur->alphamod != want->alphamod) rSDL_SetSurfaceAlphaMod(surface2, want->alphamod);
+	if (cur->keyed != want->keyed || (want->keyed && cur->key != want->key))
+		rSDL_SetColorKey(surface2, want->keyed ? SDL_TRUE : SDL_FALSE, want->key);
+	*cur = *want;
+}
+
 static void update_surface_blend (SDL1_Surface *surface) {
 	int isalpha = surface->format->Amask && !surface->format->palette;
 	int colorkey = (surface->flags & SDL1_SRCCOLORKEY) && (!isalpha || !(surface->flags & SDL1_SRCALPHA));
 	int alphablend = surface->flags & SDL1_SRCALPHA && (isalpha || surface->format->alpha != 255);
-	rSDL_SetSurfaceRLE(surface->sdl2_surface, surface->flags & SDL1_RLEACCEL);
-	rSDL_SetSurfaceBlendMode(surface->sdl2_surface, alphablend ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
-	rSDL_SetSurfaceAlphaMod(surface->sdl2_surface, (isalpha || !alphablend) ? 255 : surface->format->alpha);
-	rSDL_SetColorKey(surface->sdl2_surface, colorkey ? SDL_TRUE : SDL_FALSE, surface->format->colorkey);
+	blit_state want;
+	want.rle = (surface->flags & SDL1_RLEACCEL) ? 1 : 0;
+	want.blend = alphablend ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE;
+	want.alphamod = (isalpha || !alphablend) ? 255 : surface->format->alpha;
+	want.keyed = colorkey;
+	want.key = surface->format->colorkey;
+	apply_blit_state(surface->sdl2_surface, &((SDL1_Proxy *)surface)->blit, &want);
 	surface->offset = SDL_MUSTLOCK(surface->sdl2_surface);
 }
 
@@ -174,11 +364,12 @@ DECLSPEC SDL1_Surface *SDLCALL SDL_CreateRGBSurface (Uint32 flags, int width, in
 	SDL_Surface *surface2;
 	SDL1_Surface *surface;
 	if (Amask) flags |= SDL1_SRCALPHA;
-	surface2 = rSDL_CreateRGBSurface(0, width, height, depth, Rmask, Gmask, Bmask, Amask);
+	surface2 = reuse_surface(width, height, depth, Rmask, Gmask, Bmask, Amask);
+	if (!surface2) surface2 = rSDL_CreateRGBSurface(0, width, height, depth, Rmask, Gmask, Bmask, Amask);
 	if (!surface2) return NULL;
 	surface = SDLCL_CreateSurfaceFromSDL2(surface2);
 	if (!surface) {
-		rSDL_FreeSurface(surface2);
+		if (!cache_surface(surface2)) rSDL_FreeSurface(surface2);
 		return NULL;
 	}
 	surface->flags |= flags & (SDL1_SRCCOLORKEY | SDL1_SRCALPHA);
@@ -236,6 +427,8 @@ DECLSPEC void SDL_SetClipRect (SDL1_Surface *surface, SDL1_Rect *rect) {
 
 DECLSPEC int SDLCALL SDL_FillRect (SDL1_Surface *dst, SDL1_Rect *dstrect, Uint32 color) {
 	SDL_Rect rect2, *rectptr = NULL;
+	Uint64 start = SDLCL_StatStart();
+	int ret;
 	if (dstrect) {
 		rect2.x = dstrect->x;
 		rect2.y = dstrect->y;
@@ -243,15 +436,19 @@ DECLSPEC int SDLCALL SDL_FillRect (SDL1_Surface *dst, SDL1_Rect *dstrect, Uint32
 		rect2.h = dstrect->h;
 		rectptr = &rect2;
 	}
-	return rSDL_FillRect(dst->sdl2_surface, rectptr, color);
+	ret = rSDL_FillRect(dst->sdl2_surface, rectptr, color);
+	SDLCL_StatEnd(SDLCL_STAT_FILL, start);
+	return ret;
 }
 
 /* a.k.a. SDL_BlitSurface() */
 DECLSPEC int SDLCALL SDL_UpperBlit (SDL1_Surface *src, SDL1_Rect *srcrect, SDL1_Surface *dst, SDL1_Rect *dstrect) {
 	SDL_Rect srcrect2, *srcptr = NULL;
 	SDL_Rect dstrect2, *dstptr = NULL;
+	Uint64 start;
 	int ret;
 	if (!src || !dst) return -1;
+	start = SDLCL_StatStart();
 	if (srcrect) {
 		srcrect2.x = srcrect->x;
 		srcrect2.y = srcrect->y;
@@ -273,12 +470,110 @@ DECLSPEC int SDLCALL SDL_UpperBlit (SDL1_Surface *src, SDL1_Rect *srcrect, SDL1_
 		dstrect->w = dstrect2.w;
 		dstrect->h = dstrect2.h;
 	}
+	SDLCL_StatEnd(SDLCL_STAT_BLIT, start);
+	return ret;
+}
+
+/* Clip a blit the way SDL_UpperBlit() does and perform it, leaving the
+ * final destination rectangle in dstrect
+ */
+static int clip_blit (SDL1_Surface *src, const SDL1_Rect *srcrect, SDL_Surface *dst2, SDL_Rect *dstrect) {
+	SDL_Rect srcrect2;
+	const SDL_Rect *clip = &dst2->clip_rect;
+	int srcx = 0, srcy = 0, w = src->w, h = src->h, d;
+	if (srcrect) {
+		srcx = srcrect->x;
+		srcy = srcrect->y;
+		w = srcrect->w;
+		h = srcrect->h;
+		if (srcx < 0) {
+			w += srcx;
+			dstrect->x -= srcx;
+			srcx = 0;
+		}
+		if (w > src->w - srcx) w = src->w - srcx;
+		if (srcy < 0) {
+			h += srcy;
+			dstrect->y -= srcy;
+			srcy = 0;
+		}
+		if (h > src->h - srcy) h = src->h - srcy;
+	}
+	d = clip->x - dstrect->x;
+	if (d > 0) {
+		w -= d;
+		dstrect->x += d;
+		srcx += d;
+	}
+	d = dstrect->x + w - clip->x - clip->w;
+	if (d > 0) w -= d;
+	d = clip->y - dstrect->y;
+	if (d > 0) {
+		h -= d;
+		dstrect->y += d;
+		srcy += d;
+	}
+	d = dstrect->y + h - clip->y - clip->h;
+	if (d > 0) h -= d;
+	if (w <= 0 || h <= 0) {
+		dstrect->w = dstrect->h = 0;
+		return 0;
+	}
+	srcrect2.x = srcx;
+	srcrect2.y = srcy;
+	srcrect2.w = dstrect->w = w;
+	srcrect2.h = dstrect->h = h;
+	return rSDL_LowerBlit(src->sdl2_surface, &srcrect2, dst2, dstrect);
+}
+
+/* SDL 2.0 keeps the blit mapping on each source surface, and it stays valid
+ * for the same destination whatever order the blits come in. What a batch
+ * saves is the per-call overhead: the rectangle conversions and timing of
+ * SDL_UpperBlit(), and SDL 2.0's own clipping wrapper.
+ */
+DECLSPEC int SDLCALL SDLCL_BlitBatch (SDL1_Surface *dst, SDLCL_BlitItem *items, int count, Uint32 flags) {
+	SDLCL_BlitItem *item;
+	SDL_Rect dstrect;
+	Uint64 start;
+	int i, ret = 0;
+	(void)flags;
+	if (!dst || count < 0 || (count && !items)) return -1;
+	/* Locked surfaces are refused as by SDL_UpperBlit() */
+	if (dst->sdl2_surface->locked) return rSDL_SetError("Surfaces must not be locked during blit");
+	start = SDLCL_StatStart();
+	for (i = 0; i < count; i++) {
+		item = &items[i];
+		if (!item->src) {
+			ret = -1;
+			continue;
+		}
+		if (item->src->sdl2_surface->locked) {
+			ret = rSDL_SetError("Surfaces must not be locked during blit");
+			continue;
+		}
+		if (item->dstrect) {
+			dstrect.x = item->dstrect->x;
+			dstrect.y = item->dstrect->y;
+		} else {
+			dstrect.x = dstrect.y = 0;
+		}
+		if (clip_blit(item->src, item->srcrect, dst->sdl2_surface, &dstrect) < 0) ret = -1;
+		if (item->dstrect) {
+			item->dstrect->x = dstrect.x;
+			item->dstrect->y = dstrect.y;
+			item->dstrect->w = dstrect.w;
+			item->dstrect->h = dstrect.h;
+		}
+	}
+	SDLCL_StatEnd(SDLCL_STAT_BLIT, start);
 	return ret;
 }
 
 DECLSPEC int SDLCALL SDL_LowerBlit (SDL1_Surface *src, SDL1_Rect *srcrect, SDL1_Surface *dst, SDL1_Rect *dstrect) {
 	SDL_Rect srcrect2, *srcptr = NULL;
 	SDL_Rect dstrect2;
+	Uint64 start = SDLCL_StatStart();
+	int ret;
 	if (srcrect) {
 		srcrect2.x = srcrect->x;
 		srcrect2.y = srcrect->y;
@@ -290,7 +585,9 @@ DECLSPEC int SDLCALL SDL_LowerBlit (SDL1_Surface *src, SDL1_Rect *srcrect, SDL1_
 	dstrect2.y = dstrect->y;
 	dstrect2.w = dstrect->w;
 	dstrect2.h = dstrect->h;
-	return rSDL_LowerBlit(src->sdl2_surface, srcptr, dst->sdl2_surface, &dstrect2);
+	ret = rSDL_LowerBlit(src->sdl2_surface, srcptr, dst->sdl2_surface, &dstrect2);
+	SDLCL_StatEnd(SDLCL_STAT_BLIT, start);
+	return ret;
 }
 
 DECLSPEC int SDLCALL SDL_LockSurface (SDL1_Surface *surface) {
@@ -335,23 +632,122 @@ static Uint32 map_component (Uint8 v, Uint8 loss, Uint8 shift, Uint32 mask) {
 	return (((Uint32)v >> loss) << shift) & mask;
 }
 
+/* Nearest color lookups are memoized per palette, and misses search the
+ * palette outwards from the requested red component so most entries can be
+ * skipped. Ties go to the lowest index, as with a plain linear scan. Caches
+ * keep a copy of the colors they were built for and are matched against
+ * it, since applications may change or reuse a palette behind our back.
+ */
+#define COLOR_CACHE_SLOTS 2
+#define COLOR_CACHE_SIZE 4096
+#define COLOR_CACHE_VALID 0x01000000
+
+typedef struct {
+	int ncolors;
+	SDL1_Color colors[256];
+	Uint8 order[256];
+	Uint32 keys[COLOR_CACHE_SIZE];
+	Uint8 values[COLOR_CACHE_SIZE];
+} color_cache;
+
+/* Held from get_color_cache() until the caller is done with the cache */
+static SDL_SpinLock color_cache_lock = 0;
+static color_cache color_caches[COLOR_CACHE_SLOTS];
+static int next_color_cache = 0;
+
+/* Palettes of 1 to 256 colors only, with color_cache_lock held */
+static color_cache *get_color_cache (const SDL1_Palette *palette) {
+	color_cache *cache;
+	size_t size = palette->ncolors * sizeof(SDL1_Color);
+	int count[257];
+	int i;
+	for (i = 0; i < COLOR_CACHE_SLOTS; i++) {
+		cache = &color_caches[i];
+		if (cache->ncolors == palette->ncolors && !memcmp(cache->colors, palette->colors, size)) return cache;
+	}
+	cache = &color_caches[next_color_cache];
+	next_color_cache = (next_color_cache + 1) % COLOR_CACHE_SLOTS;
+	cache->ncolors = palette->ncolors;
+	memcpy(cache->colors, palette->colors, size);
+	memset(cache->keys, 0, sizeof(cache->keys));
+	/* Stable counting sort of the entries by red */
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < cache->ncolors; i++) count[cache->colors[i].r + 1]++;
+	for (i = 1; i < 257; i++) count[i] += count[i - 1];
+	for (i = 0; i < cache->ncolors; i++) cache->order[count[cache->colors[i].r]++] = i;
+	return cache;
+}
+
+static int color_dist (const SDL1_Color *color, Uint8 r, Uint8 g, Uint8 b) {
+	int rd = color->r - r;
+	int gd = color->g - g;
+	int bd = color->b - b;
+	return (rd * rd) + (gd * gd) + (bd * bd);
+}
+
+static Uint32 scan_nearest (const SDL1_Palette *palette, Uint8 r, Uint8 g, Uint8 b) {
+	int i, dist, min = (256 * 256) * 3;
+	Uint32 color = 0;
+	for (i = 0; i < palette->ncolors; i++) {
+		dist = color_dist(&palette->colors[i], r, g, b);
+		if (dist < min) {
+			color = i;
+			if (dist == 0) break;
+			min = dist;
+		}
+	}
+	return color;
+}
+
+static Uint8 find_nearest (const color_cache *cache, Uint8 r, Uint8 g, Uint8 b) {
+	const SDL1_Color *colors = cache->colors;
+	int lo = 0, hi = cache->ncolors, mid, i, idx, dist, rd;
+	int best = (256 * 256) * 3, color = 0;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (colors[cache->order[mid]].r < r) lo = mid + 1;
+		else hi = mid;
+	}
+	/* Entries further away in red than the best distance can't win */
+	for (i = lo; i < cache->ncolors; i++) {
+		idx = cache->order[i];
+		rd = colors[idx].r - r;
+		if (rd * rd > best) break;
+		dist = color_dist(&colors[idx], r, g, b);
+		if (dist < best || (dist == best && idx < color)) {
+			best = dist;
+			color = idx;
+		}
+	}
+	for (i = lo - 1; i >= 0; i--) {
+		idx = cache->order[i];
+		rd = colors[idx].r - r;
+		if (rd * rd > best) break;
+		dist = color_dist(&colors[idx], r, g, b);
+		if (dist < best || (dist == best && idx < color)) {
+			best = dist;
+			color = idx;
+		}
+	}
+	return color;
+}
+
 DECLSPEC Uint32 SDLCALL SDL_MapRGBA (SDL1_PixelFormat *fmt, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
-	int i, dist, min, rd, gd, bd;
-	Uint32 color;
+	color_cache *cache;
+	Uint32 color, key, slot;
 	if (fmt->palette) {
-		min = (256 * 256) * 3;
-		color = 0;
-		for (i = 0; i < fmt->palette->ncolors; i++) {
-			rd = fmt->palette->colors[i].r - r;
-			gd = fmt->palette->colors[i].g - g;
-			bd = fmt->palette->colors[i].b - b;
-			dist = (rd * rd) + (gd * gd) + (bd * bd);
-			if (dist < min) {
-				color = i;
-				if (dist == 0) break;
-				min = dist;
-			}
+		if (fmt->palette->ncolors > 256) return scan_nearest(fmt->palette, r, g, b);
+		if (fmt->palette->ncolors <= 0) return 0;
+		key = ((Uint32)r << 16) | ((Uint32)g << 8) | b | COLOR_CACHE_VALID;
+		slot = ((key * 2654435761u) >> 20) & (COLOR_CACHE_SIZE - 1);
+		rSDL_AtomicLock(&color_cache_lock);
+		cache = get_color_cache(fmt->palette);
+		if (cache->keys[slot] != key) {
+			cache->values[slot] = find_nearest(cache, r, g, b);
+			cache->keys[slot] = key;
 		}
+		color = cache->values[slot];
+		rSDL_AtomicUnlock(&color_cache_lock);
 		return color;
 	} else {
 		color = map_component(r, fmt->Rloss, fmt->Rshift, fmt->Rmask);
@@ -366,14 +762,42 @@ DECLSPEC Uint32 SDLCALL SDL_MapRGB (SDL1_PixelFormat *fmt, Uint8 r, Uint8 g, Uin
 	return SDL_MapRGBA(fmt, r, g, b, 255);
 }
 
+/* Channel values expanded to 8 bits by bit replication, indexed by the
+ * channel's loss and then its value. These only depend on the loss, so
+ * one set of tables serves every pixel format. They are built when the
+ * library is loaded, before any thread can read them.
+ */
+static Uint8 expand_tables[9][256];
+
+__attribute__ ((constructor)) static void init_expand_tables (void) {
+	int loss, i, s;
+	Uint8 v;
+	for (loss = 0; loss <= 8; loss++) {
+		for (i = 0; i < 256; i++) {
+			v = i << loss;
+			for (s = 8 - loss; s && s < 8; s *= 2)
+				v |= v >> s;
+			expand_tables[loss][i] = v;
+		}
+	}
+}
+
 static Uint8 get_component (Uint32 pixel, Uint8 loss, Uint8 shift, Uint32 mask) {
-	Uint8 v = ((pixel & mask) >> shift) << loss;
-	int s = 8 - loss;
-	while (s < 8) {
-		v |= v >> s;
-		s *= 2;
+	return expand_tables[loss <= 8 ? loss : 0][(Uint8)((pixel & mask) >> shift)];
+}
+
+/* Pixel layouts with their own conversion paths */
+enum { FORMAT_OTHER, FORMAT_RGB565, FORMAT_RGB555, FORMAT_RGB888 };
+
+static int format_kind (const SDL1_PixelFormat *fmt) {
+	if (fmt->BytesPerPixel == 2 && fmt->Bmask == 0x001F && !fmt->Amask) {
+		if (fmt->Rmask == 0xF800 && fmt->Gmask == 0x07E0) return FORMAT_RGB565;
+		if (fmt->Rmask == 0x7C00 && fmt->Gmask == 0x03E0) return FORMAT_RGB555;
 	}
-	return v;
+	/* Also covers ARGB8888, the alpha channel is decoded separately */
+	if (fmt->BytesPerPixel >= 3 && fmt->Rmask == 0xFF0000 && fmt->Gmask == 0xFF00 && fmt->Bmask == 0xFF &&
+		(!fmt->Amask || fmt->Amask == 0xFF000000)) return FORMAT_RGB888;
+	return FORMAT_OTHER;
 }
 
 DECLSPEC void SDLCALL SDL_GetRGBA (Uint32 pixel, SDL1_PixelFormat *fmt, Uint8 *r, Uint8 *g, Uint8 *b, Uint8 *a) {
@@ -382,12 +806,34 @@ DECLSPEC void SDLCALL SDL_GetRGBA (Uint32 pixel, SDL1_PixelFormat *fmt, Uint8 *r
 		*g = fmt->palette->colors[pixel].g;
 		*b = fmt->palette->colors[pixel].b;
 		*a = 255;
-	} else {
-		*r = get_component(pixel, fmt->Rloss, fmt->Rshift, fmt->Rmask);
-		*g = get_component(pixel, fmt->Gloss, fmt->Gshift, fmt->Gmask);
-		*b = get_component(pixel, fmt->Bloss, fmt->Bshift, fmt->Bmask);
-		if (fmt->Amask) *a = get_component(pixel, fmt->Aloss, fmt->Ashift, fmt->Amask);
-		else *a = 255;
+		return;
+	}
+	switch (format_kind(fmt)) {
+		case FORMAT_RGB565:
+			*r = expand_tables[3][(pixel >> 11) & 0x1F];
+			*g = expand_tables[2][(pixel >> 5) & 0x3F];
+			*b = expand_tables[3][pixel & 0x1F];
+			*a = 255;
+			break;
+		case FORMAT_RGB555:
+			*r = expand_tables[3][(pixel >> 10) & 0x1F];
+			*g = expand_tables[3][(pixel >> 5) & 0x1F];
+			*b = expand_tables[3][pixel & 0x1F];
+			*a = 255;
+			break;
+		case FORMAT_RGB888:
+			*r = pixel >> 16;
+			*g = pixel >> 8;
+			*b = pixel;
+			*a = fmt->Amask ? pixel >> 24 : 255;
+			break;
+		default:
+			*r = get_component(pixel, fmt->Rloss, fmt->Rshift, fmt->Rmask);
+			*g = get_component(pixel, fmt->Gloss, fmt->Gshift, fmt->Gmask);
+			*b = get_component(pixel, fmt->Bloss, fmt->Bshift, fmt->Bmask);
+			if (fmt->Amask) *a = get_component(pixel, fmt->Aloss, fmt->Ashift, fmt->Amask);
+			else *a = 255;
+			break;
 	}
 }
 
@@ -396,6 +842,278 @@ DECLSPEC void SDLCALL SDL_GetRGB (Uint32 pixel, SDL1_PixelFormat *fmt, Uint8 *r,
 	SDL_GetRGBA(pixel, fmt, r, g, b, &a);
 }
 
+/* Array conversion between pixel formats and packed RGBA8888 (0xRRGGBBAA).
+ * The 16-bit kernels take the number of green bits to cover both RGB565
+ * and RGB555.
+ */
+static void map_rgba16_c (Uint16 *dst, const Uint32 *src, int count, int gbits) {
+	Uint32 p;
+	while (count--) {
+		p = *src++;
+		*dst++ = ((p >> 27) << (5 + gbits)) |
+			(((p >> (24 - gbits)) & ((1 << gbits) - 1)) << 5) |
+			((p >> 11) & 0x1F);
+	}
+}
+
+static void get_rgba16_c (Uint32 *dst, const Uint16 *src, int count, int gbits) {
+	Uint32 r, g, b;
+	while (count--) {
+		r = (*src >> (5 + gbits)) & 0x1F;
+		g = (*src >> 5) & ((1 << gbits) - 1);
+		b = *src++ & 0x1F;
+		r = (r << 3) | (r >> 2);
+		g = (g << (8 - gbits)) | (g >> (2 * gbits - 8));
+		b = (b << 3) | (b >> 2);
+		*dst++ = (r << 24) | (g << 16) | (b << 8) | 0xFF;
+	}
+}
+
+static void map_rgba32_c (Uint32 *dst, const Uint32 *src, int count, int alpha) {
+	if (alpha) {
+		while (count--) {
+			*dst++ = (*src >> 8) | (*src << 24);
+			src++;
+		}
+	} else {
+		while (count--) *dst++ = *src++ >> 8;
+	}
+}
+
+static void get_rgba32_c (Uint32 *dst, const Uint32 *src, int count, int alpha) {
+	if (alpha) {
+		while (count--) {
+			*dst++ = (*src << 8) | (*src >> 24);
+			src++;
+		}
+	} else {
+		while (count--) *dst++ = (*src++ << 8) | 0xFF;
+	}
+}
+
+#ifdef SDLCL_X86_SIMD
+__attribute__((target("sse2")))
+static void map_rgba16_sse2 (Uint16 *dst, const Uint32 *src, int count, int gbits) {
+	const __m128i rshift = _mm_cvtsi32_si128(5 + gbits);
+	const __m128i gshift = _mm_cvtsi32_si128(24 - gbits);
+	const __m128i gmask = _mm_set1_epi32((1 << gbits) - 1);
+	const __m128i bmask = _mm_set1_epi32(0x1F);
+	__m128i p[2];
+	int i;
+	for (; count >= 8; count -= 8) {
+		for (i = 0; i < 2; i++) {
+			p[i] = _mm_loadu_si128((const __m128i *)(src + i * 4));
+			p[i] = _mm_or_si128(_mm_or_si128(
+				_mm_sll_epi32(_mm_srli_epi32(p[i], 27), rshift),
+				_mm_slli_epi32(_mm_and_si128(_mm_srl_epi32(p[i], gshift), gmask), 5)),
+				_mm_and_si128(_mm_srli_epi32(p[i], 11), bmask));
+			/* Sign extend so the saturating pack keeps all 16 bits */
+			p[i] = _mm_srai_epi32(_mm_slli_epi32(p[i], 16), 16);
+		}
+		_mm_storeu_si128((__m128i *)dst, _mm_packs_epi32(p[0], p[1]));
+		dst += 8;
+		src += 8;
+	}
+	map_rgba16_c(dst, src, count, gbits);
+}
+
+__attribute__((target("sse2")))
+static void get_rgba16_sse2 (Uint32 *dst, const Uint16 *src, int count, int gbits) {
+	const __m128i rshift = _mm_cvtsi32_si128(5 + gbits);
+	const __m128i gup = _mm_cvtsi32_si128(8 - gbits);
+	const __m128i gdown = _mm_cvtsi32_si128(2 * gbits - 8);
+	const __m128i gmask = _mm_set1_epi32((1 << gbits) - 1);
+	const __m128i mask5 = _mm_set1_epi32(0x1F);
+	const __m128i alpha = _mm_set1_epi32(0xFF);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i x, p[2], r, g, b;
+	int i;
+	for (; count >= 8; count -= 8) {
+		x = _mm_loadu_si128((const __m128i *)src);
+		p[0] = _mm_unpacklo_epi16(x, zero);
+		p[1] = _mm_unpackhi_epi16(x, zero);
+		for (i = 0; i < 2; i++) {
+			r = _mm_and_si128(_mm_srl_epi32(p[i], rshift), mask5);
+			g = _mm_and_si128(_mm_srli_epi32(p[i], 5), gmask);
+			b = _mm_and_si128(p[i], mask5);
+			r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+			g = _mm_or_si128(_mm_sll_epi32(g, gup), _mm_srl_epi32(g, gdown));
+			b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+			_mm_storeu_si128((__m128i *)(dst + i * 4), _mm_or_si128(
+				_mm_or_si128(_mm_slli_epi32(r, 24), _mm_slli_epi32(g, 16)),
+				_mm_or_si128(_mm_slli_epi32(b, 8), alpha)));
+		}
+		dst += 8;
+		src += 8;
+	}
+	get_rgba16_c(dst, src, count, gbits);
+}
+
+__attribute__((target("sse2")))
+static void map_rgba32_sse2 (Uint32 *dst, const Uint32 *src, int count, int alpha) {
+	__m128i p;
+	for (; count >= 4; count -= 4) {
+		p = _mm_loadu_si128((const __m128i *)src);
+		if (alpha) p = _mm_or_si128(_mm_srli_epi32(p, 8), _mm_slli_epi32(p, 24));
+		else p = _mm_srli_epi32(p, 8);
+		_mm_storeu_si128((__m128i *)dst, p);
+		dst += 4;
+		src += 4;
+	}
+	map_rgba32_c(dst, src, count, alpha);
+}
+
+__attribute__((target("sse2")))
+static void get_rgba32_sse2 (Uint32 *dst, const Uint32 *src, int count, int alpha) {
+	const __m128i opaque = _mm_set1_epi32(0xFF);
+	__m128i p;
+	for (; count >= 4; count -= 4) {
+		p = _mm_loadu_si128((const __m128i *)src);
+		if (alpha) p = _mm_or_si128(_mm_slli_epi32(p, 8), _mm_srli_epi32(p, 24));
+		else p = _mm_or_si128(_mm_slli_epi32(p, 8), opaque);
+		_mm_storeu_si128((__m128i *)dst, p);
+		dst += 4;
+		src += 4;
+	}
+	get_rgba32_c(dst, src, count, alpha);
+}
+#endif
+
+static Uint32 read_pixel (const Uint8 *p, int bytespp) {
+	switch (bytespp) {
+		case 1: return *p;
+		case 2: return *(const Uint16 *)p;
+		case 3: return p[0] | (p[1] << 8) | (p[2] << 16);
+		default: return *(const Uint32 *)p;
+	}
+}
+
+static void write_pixel (Uint8 *p, int bytespp, Uint32 pixel) {
+	switch (bytespp) {
+		case 1: *p = pixel; break;
+		case 2: *(Uint16 *)p = pixel; break;
+		case 3:
+			p[0] = pixel;
+			p[1] = pixel >> 8;
+			p[2] = pixel >> 16;
+			break;
+		default: *(Uint32 *)p = pixel; break;
+	}
+}
+
+DECLSPEC int SDLCALL SDLCL_MapRGBAArray (const SDL1_PixelFormat *fmt, const Uint32 *rgba, void *pixels, int count) {
+	color_cache *cache;
+	Uint8 *dst = pixels;
+	Uint32 key, slot, p;
+	int i;
+#ifdef SDLCL_X86_SIMD
+	int simd = SDLCL_GetSIMDLevel() >= SDLCL_SIMD_SSE2;
+#endif
+	if (!fmt || fmt->BytesPerPixel < 1 || fmt->BytesPerPixel > 4 || count < 0) return -1;
+	if (fmt->palette) {
+		if (fmt->palette->ncolors > 256) {
+			for (i = 0; i < count; i++)
+				dst[i] = scan_nearest(fmt->palette, rgba[i] >> 24, rgba[i] >> 16, rgba[i] >> 8);
+			return 0;
+		}
+		if (fmt->palette->ncolors <= 0) {
+			memset(dst, 0, count);
+			return 0;
+		}
+		rSDL_AtomicLock(&color_cache_lock);
+		cache = get_color_cache(fmt->palette);
+		for (i = 0; i < count; i++) {
+			key = (rgba[i] >> 8) | COLOR_CACHE_VALID;
+			slot = ((key * 2654435761u) >> 20) & (COLOR_CACHE_SIZE - 1);
+			if (cache->keys[slot] != key) {
+				cache->values[slot] = find_nearest(cache, rgba[i] >> 24, rgba[i] >> 16, rgba[i] >> 8);
+				cache->keys[slot] = key;
+			}
+			dst[i] = cache->values[slot];
+		}
+		rSDL_AtomicUnlock(&color_cache_lock);
+		return 0;
+	}
+	switch (fmt->BytesPerPixel == 2 || fmt->BytesPerPixel == 4 ? format_kind(fmt) : FORMAT_OTHER) {
+		case FORMAT_RGB565:
+		case FORMAT_RGB555:
+#ifdef SDLCL_X86_SIMD
+			if (simd) {
+				map_rgba16_sse2(pixels, rgba, count, fmt->Gmask == 0x07E0 ? 6 : 5);
+				break;
+			}
+#endif
+			map_rgba16_c(pixels, rgba, count, fmt->Gmask == 0x07E0 ? 6 : 5);
+			break;
+		case FORMAT_RGB888:
+#ifdef SDLCL_X86_SIMD
+			if (simd) {
+				map_rgba32_sse2(pixels, rgba, count, fmt->Amask != 0);
+				break;
+			}
+#endif
+			map_rgba32_c(pixels, rgba, count, fmt->Amask != 0);
+			break;
+		default:
+			for (i = 0; i < count; i++) {
+				p = map_component(rgba[i] >> 24, fmt->Rloss, fmt->Rshift, fmt->Rmask);
+				p |= map_component(rgba[i] >> 16, fmt->Gloss, fmt->Gshift, fmt->Gmask);
+				p |= map_component(rgba[i] >> 8, fmt->Bloss, fmt->Bshift, fmt->Bmask);
+				p |= map_component(rgba[i], fmt->Aloss, fmt->Ashift, fmt->Amask);
+				write_pixel(dst + i * fmt->BytesPerPixel, fmt->BytesPerPixel, p);
+			}
+			break;
+	}
+	return 0;
+}
+
+DECLSPEC int SDLCALL SDLCL_GetRGBAArray (const SDL1_PixelFormat *fmt, const void *pixels, Uint32 *rgba, int count) {
+	const SDL1_Color *color;
+	const Uint8 *src = pixels;
+	Uint8 r, g, b, a;
+	int i;
+#ifdef SDLCL_X86_SIMD
+	int simd = SDLCL_GetSIMDLevel() >= SDLCL_SIMD_SSE2;
+#endif
+	if (!fmt || fmt->BytesPerPixel < 1 || fmt->BytesPerPixel > 4 || count < 0) return -1;
+	if (fmt->palette) {
+		for (i = 0; i < count; i++) {
+			color = &fmt->palette->colors[src[i]];
+			rgba[i] = ((Uint32)color->r << 24) | ((Uint32)color->g << 16) | ((Uint32)color->b << 8) | 0xFF;
+		}
+		return 0;
+	}
+	switch (fmt->BytesPerPixel == 2 || fmt->BytesPerPixel == 4 ? format_kind(fmt) : FORMAT_OTHER) {
+		case FORMAT_RGB565:
+		case FORMAT_RGB555:
+#ifdef SDLCL_X86_SIMD
+			if (simd) {
+				get_rgba16_sse2(rgba, pixels, count, fmt->Gmask == 0x07E0 ? 6 : 5);
+				break;
+			}
+#endif
+			get_rgba16_c(rgba, pixels, count, fmt->Gmask == 0x07E0 ? 6 : 5);
+			break;
+		case FORMAT_RGB888:
+#ifdef SDLCL_X86_SIMD
+			if (simd) {
+				get_rgba32_sse2(rgba, pixels, count, fmt->Amask != 0);
+				break;
+			}
+#endif
+			get_rgba32_c(rgba, pixels, count, fmt->Amask != 0);
+			break;
+		default:
+			for (i = 0; i < count; i++) {
+				SDL_GetRGBA(read_pixel(src + i * fmt->BytesPerPixel, fmt->BytesPerPixel),
+					(SDL1_PixelFormat *)fmt, &r, &g, &b, &a);
+				rgba[i] = ((Uint32)r << 24) | ((Uint32)g << 16) | ((Uint32)b << 8) | a;
+			}
+			break;
+	}
+	return 0;
+}
+
 typedef struct SDL1_VideoInfo {
 	Uint32 hw_available :1;
 	Uint32 wm_available :1;
@@ -580,13 +1298,25 @@ DECLSPEC int SDLCALL SDL_VideoModeOK(int width, int height, int bpp, Uint32 flag
 SDL_Window *SDLCL_window = NULL;
 SDL_Renderer *SDLCL_renderer = NULL;
 static SDL_Texture *main_texture = NULL;
+static SDL_Texture *cursor_texture = NULL;
+static int cursor_texture_serial;
+static SDL_Texture *prescale_texture = NULL;
+static int prescale_width, prescale_height;
+static int prescale_failed = 0;
 static SDL_GLContext main_glcontext = NULL;
 SDL1_Surface *SDLCL_surface = NULL;
 
 static SDL_GLContext scale_glcontext = NULL;
+static int gl_fbo = 0;
+static GLuint fbo_framebuffer, fbo_renderbuffer, fbo_texture, fbo_cursor;
+static GLuint fbo_sharp_framebuffer, fbo_sharp_renderbuffer;
 
 static SDL1_PixelFormat texture_format;
 static Uint32 physical_palette[256];
+/* Set when the physical palette changes. Like SDL 1.2, the next update then
+ * redraws the whole screen, since pixels outside it change color too.
+ */
+static int palette_dirty = 0;
 
 static Uint32 mode_flags = 0;
 static SDL_bool grab = SDL_FALSE;
@@ -594,27 +1324,190 @@ static SDL_bool grab = SDL_FALSE;
 static char *window_title = NULL;
 static char *window_icon = NULL;
 
+#define MAX_DIRTY_RECTS 16
+
+/* Deferred presentation state */
+static Uint32 defer_budget = 0;
+static SDL_Rect pending_rects[MAX_DIRTY_RECTS];
+static int num_pending = 0;
+static Uint32 pending_since;
+static SDL_threadID defer_thread;  /* The thread that set the video mode */
+static SDLCL_VideoStats video_stats;
+/* Where screen uploads are counted. While the presenter thread runs, it is
+ * the only thread uploading and counts into present_stats, which it adds
+ * to video_stats under present_lock after each frame.
+ */
+static SDLCL_VideoStats present_stats;
+static SDLCL_VideoStats *upload_stats = &video_stats;
+
+/* The cursor drawn over a scaled frame, captured on the application's
+ * thread when the frame is updated so the presenter thread never touches
+ * the cursor itself
+ */
+typedef struct {
+	int visible;
+	int x, y;     /* Top left corner on the screen surface */
+	int w, h;
+	int serial;   /* SDLCL_cursor_serial when the image was copied */
+	Uint8 *image; /* Luminance and alpha pairs */
+} cursor_shot;
+
+static cursor_shot screen_cursor;
+
+static void free_cursor_shot (cursor_shot *shot) {
+	free(shot->image);
+	shot->image = NULL;
+	shot->visible = 0;
+}
+
+/* Presenter thread state */
+#define MAX_STAGING 3
+
+typedef struct {
+	Uint8 *pixels;
+	Uint32 palette[256];
+	SDL_Rect rects[MAX_DIRTY_RECTS];
+	int numrects;
+	cursor_shot cursor;
+} staging_buffer;
+
+enum { PRESENT_STARTING, PRESENT_RUNNING, PRESENT_FAILED, PRESENT_QUIT };
+
+static SDL_Thread *present_thread = NULL;
+static SDL_mutex *present_lock = NULL;
+static SDL_cond *present_cond = NULL;
+static int present_state;
+static int present_width, present_height;
+static staging_buffer staging[MAX_STAGING];
+static int num_staging = 0;
+static int present_queue[MAX_STAGING];
+static int queue_len = 0;
+static int present_busy = -1;
+
+/* Dirty tile state */
+static int tile_size = 0;
+static int tiles_across, tiles_down;
+static Uint8 *tile_shadow = NULL;
+static Uint8 *tile_stale = NULL;
+static Uint32 tile_palette[256];
+
 int SDLCL_scaling = 0;
 int SDLCL_virtual_width, SDLCL_virtual_height;
 static int real_width, real_height;
 SDL_Rect SDLCL_scale_rect;
 
+enum {
+	SCALE_LINEAR,
+	SCALE_NEAREST,
+	SCALE_INTEGER,
+	SCALE_SHARP
+};
+static int scale_mode = SCALE_LINEAR;
+
+/* SDLCL_SCALE_MODE picks how the screen is stretched to fill a window of
+ * a different size
+ */
+static void init_scale_mode (void) {
+	const char *env = getenv("SDLCL_SCALE_MODE");
+	scale_mode = SCALE_LINEAR;
+	if (!env) return;
+	if (!strcmp(env, "nearest")) scale_mode = SCALE_NEAREST;
+	else if (!strcmp(env, "integer")) scale_mode = SCALE_INTEGER;
+	else if (!strcmp(env, "sharp")) scale_mode = SCALE_SHARP;
+}
+
 DECLSPEC void SDLCALL SDL_FreeSurface (SDL1_Surface *surface) {
 	SDL1_Proxy *proxy;
 	if (surface && surface != SDLCL_surface) {
 		proxy = (SDL1_Proxy *)surface;
-		rSDL_FreeSurface(surface->sdl2_surface);
-		free(proxy);
+		if (!cache_surface(surface->sdl2_surface)) rSDL_FreeSurface(surface->sdl2_surface);
+		free_proxy(proxy);
+	}
+}
+
+static Uint32 screen_texfmt;
+
+static void close_renderer (void) {
+	if (prescale_texture) {
+		rSDL_DestroyTexture(prescale_texture);
+		prescale_texture = NULL;
+	}
+	prescale_failed = 0;
+	if (cursor_texture) {
+		rSDL_DestroyTexture(cursor_texture);
+		cursor_texture = NULL;
+	}
+	if (main_texture) {
+		rSDL_DestroyTexture(main_texture);
+		main_texture = NULL;
+	}
+	if (SDLCL_renderer) {
+		rSDL_DestroyRenderer(SDLCL_renderer);
+		SDLCL_renderer = NULL;
+	}
+}
+
+/* Create the renderer and the streaming texture for the screen */
+static int open_renderer (int width, int height) {
+	SDLCL_renderer = rSDL_CreateRenderer(SDLCL_window, -1, 0);
+	if (!SDLCL_renderer) return -1;
+	rSDL_SetRenderDrawColor(SDLCL_renderer, 0, 0, 0, 255);
+	rSDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, scale_mode == SCALE_LINEAR ? "1" : "0");
+	main_texture = rSDL_CreateTexture(SDLCL_renderer, screen_texfmt, SDL_TEXTUREACCESS_STREAMING, width, height);
+	if (!main_texture) {
+		close_renderer();
+		return -1;
+	}
+	rSDL_SetTextureBlendMode(main_texture, SDL_BLENDMODE_NONE);
+	return 0;
+}
+
+static void free_tiles (void) {
+	free(tile_shadow);
+	tile_shadow = NULL;
+	free(tile_stale);
+	tile_stale = NULL;
+	tile_size = 0;
+}
+
+/* With SDLCL_DIRTY_TILES set to a tile size in pixels, screen updates keep
+ * a copy of what was last uploaded and only upload the tiles that changed.
+ * This helps applications that flip the whole screen every frame while
+ * changing little of it.
+ */
+static void init_tiles (void) {
+	const char *env = getenv("SDLCL_DIRTY_TILES");
+	int size = env ? atoi(env) : 0;
+	if (size <= 0) return;
+	if (size < 8) size = 8;
+	tiles_across = (SDLCL_surface->w + size - 1) / size;
+	tiles_down = (SDLCL_surface->h + size - 1) / size;
+	tile_shadow = malloc(SDLCL_surface->pitch * SDLCL_surface->h);
+	tile_stale = malloc(tiles_across * tiles_down);
+	if (!tile_shadow || !tile_stale) {
+		free_tiles();
+		return;
 	}
+	memset(tile_stale, 1, tiles_across * tiles_down);
+	tile_size = size;
 }
 
 static void close_window (void) {
 	SDL1_Surface *surface;
+	SDLCL_FlushScreen();
+	stop_present_thread();
+	free_tiles();
+	free_cursor_shot(&screen_cursor);
+	num_pending = 0;
 	if (SDLCL_surface) {
 		surface = SDLCL_surface;
 		SDLCL_surface = NULL;
 		SDL_FreeSurface(surface);
 	}
+	/* The framebuffer objects go away with the context */
+	gl_fbo = 0;
+	fbo_cursor = 0;
+	fbo_sharp_framebuffer = 0;
 	if (scale_glcontext) {
 		rSDL_GL_DeleteContext(scale_glcontext);
 		scale_glcontext = NULL;
@@ -623,14 +1516,7 @@ static void close_window (void) {
 		rSDL_GL_DeleteContext(main_glcontext);
 		main_glcontext = NULL;
 	}
-	if (main_texture) {
-		rSDL_DestroyTexture(main_texture);
-		main_texture = NULL;
-	}
-	if (SDLCL_renderer) {
-		rSDL_DestroyRenderer(SDLCL_renderer);
-		SDLCL_renderer = NULL;
-	}
+	close_renderer();
 	if (SDLCL_window) {
 		rSDL_DestroyWindow(SDLCL_window);
 		SDLCL_window = NULL;
@@ -648,6 +1534,148 @@ void SDLCL_UpdateGrab (void) {
 		rSDL_SetRelativeMouseMode(SDL_FALSE);
 }
 
+/* Palette expansion kernels for 8-bit screens */
+typedef void (*expand_func) (Uint32 *dest, const Uint8 *src, const Uint32 *palette, int width);
+
+static void expand_palette_c (Uint32 *dest, const Uint8 *src, const Uint32 *palette, int width) {
+	for (; width >= 4; width -= 4) {
+		dest[0] = palette[src[0]];
+		dest[1] = palette[src[1]];
+		dest[2] = palette[src[2]];
+		dest[3] = palette[src[3]];
+		dest += 4;
+		src += 4;
+	}
+	while (width--) *dest++ = palette[*src++];
+}
+
+#ifdef SDLCL_X86_SIMD
+/* SSE2 has no gather, but four lookups can still go out in one store */
+__attribute__((target("sse2")))
+static void expand_palette_sse2 (Uint32 *dest, const Uint8 *src, const Uint32 *palette, int width) {
+	for (; width >= 4; width -= 4) {
+		_mm_storeu_si128((__m128i *)dest, _mm_setr_epi32(
+			palette[src[0]], palette[src[1]], palette[src[2]], palette[src[3]]));
+		dest += 4;
+		src += 4;
+	}
+	while (width--) *dest++ = palette[*src++];
+}
+
+__attribute__((target("avx2")))
+static void expand_palette_avx2 (Uint32 *dest, const Uint8 *src, const Uint32 *palette, int width) {
+	__m256i index;
+	for (; width >= 8; width -= 8) {
+		index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)src));
+		_mm256_storeu_si256((__m256i *)dest, _mm256_i32gather_epi32((const int *)palette, index, 4));
+		dest += 8;
+		src += 8;
+	}
+	while (width--) *dest++ = palette[*src++];
+}
+#endif
+
+static expand_func expand_palette = expand_palette_c;
+
+static void init_expand_palette (void) {
+	expand_palette = expand_palette_c;
+#ifdef SDLCL_X86_SIMD
+	switch (SDLCL_GetSIMDLevel()) {
+		case SDLCL_SIMD_AVX2: expand_palette = expand_palette_avx2; break;
+		case SDLCL_SIMD_SSE2: expand_palette = expand_palette_sse2; break;
+		default: break;
+	}
+#endif
+}
+
+/* With SDLCL_ZEROCOPY=1, the screen surface of a 15/16/32-bit mode is created
+ * directly on top of the pixel buffer behind the streaming texture, so an
+ * update only has to tell the renderer which regions changed. This relies on
+ * SDL_LockTexture() returning the same persistent buffer every time, which
+ * is only known to be true of some renderers.
+ */
+static int zero_copy = 0;
+
+static int renderer_keeps_pixels (void) {
+	static const char *const names[] = { "opengl", "opengles2", "opengles", "software", NULL };
+	SDL_RendererInfo info;
+	int i;
+	if (rSDL_GetRendererInfo(SDLCL_renderer, &info)) return 0;
+	for (i = 0; names[i]; i++)
+		if (!strcmp(info.name, names[i])) return 1;
+	return 0;
+}
+
+static SDL1_Surface *create_mapped_screen (Uint32 pixfmt, int width, int height, int bpp, Uint32 Rmask, Uint32 Gmask, Uint32 Bmask, Uint32 Amask) {
+	const char *env = getenv("SDLCL_ZEROCOPY");
+	SDL1_Surface *surface;
+	void *texpix;
+	int texpitch;
+	if (!env || !atoi(env)) return NULL;
+	if (bpp <= 8 || (int)SDL_BYTESPERPIXEL(pixfmt) != (bpp + 7) / 8) return NULL;
+	if (!renderer_keeps_pixels()) return NULL;
+	if (rSDL_LockTexture(main_texture, NULL, &texpix, &texpitch)) return NULL;
+	memset(texpix, 0, texpitch * height);
+	rSDL_UnlockTexture(main_texture);
+	/* SDL 1.2 surface pitch is only 16 bits */
+	if (texpitch > 0xFFFF) return NULL;
+	surface = SDL_CreateRGBSurfaceFrom(texpix, width, height, bpp, texpitch, Rmask, Gmask, Bmask, Amask);
+	if (surface) zero_copy = 1;
+	return surface;
+}
+
+/* Give the screen surface its own pixels again. The buffer it pointed
+ * into may already be gone, so start from the renderer's current buffer.
+ */
+static int unmap_screen (void) {
+	SDL_Surface *mapped = SDLCL_surface->sdl2_surface;
+	SDL_Surface *surface2;
+	SDL_Rect clip;
+	void *texpix;
+	int texpitch;
+	int i;
+	surface2 = rSDL_CreateRGBSurface(0, mapped->w, mapped->h, mapped->format->BitsPerPixel,
+		mapped->format->Rmask, mapped->format->Gmask, mapped->format->Bmask, mapped->format->Amask);
+	if (!surface2) return -1;
+	if (rSDL_LockTexture(main_texture, NULL, &texpix, &texpitch)) {
+		rSDL_FreeSurface(surface2);
+		return -1;
+	}
+	for (i = 0; i < mapped->h; i++)
+		memcpy((Uint8 *)surface2->pixels + i * surface2->pitch,
+			(Uint8 *)texpix + i * texpitch,
+			mapped->w * mapped->format->BytesPerPixel);
+	rSDL_UnlockTexture(main_texture);
+	zero_copy = 0;
+	rSDL_GetClipRect(mapped, &clip);
+	rSDL_SetClipRect(surface2, &clip);
+	rSDL_FreeSurface(mapped);
+	SDLCL_surface->sdl2_surface = surface2;
+	SDLCL_surface->pixels = surface2->pixels;
+	SDLCL_surface->pitch = surface2->pitch;
+	/* Carry the blend state over to the new surface */
+	memset(&((SDL1_Proxy *)SDLCL_surface)->blit, -1, sizeof(blit_state));
+	update_surface_blend(SDLCL_surface);
+	return 0;
+}
+
+/* Hand a region of a mapped screen to the renderer. Returns -2 if the
+ * screen had to be unmapped, after which all of it needs uploading.
+ */
+static int commit_rect (const SDL_Rect *rect) {
+	Uint8 *expected = (Uint8 *)SDLCL_surface->pixels + rect->y * SDLCL_surface->pitch + rect->x * SDLCL_surface->format->BytesPerPixel;
+	void *texpix;
+	int texpitch;
+	if (rSDL_LockTexture(main_texture, rect, &texpix, &texpitch)) return -1;
+	rSDL_UnlockTexture(main_texture);
+	if (texpix != expected || texpitch != SDLCL_surface->pitch) {
+		/* The renderer moved its buffer after all */
+		return unmap_screen() ? -1 : -2;
+	}
+	video_stats.mapped++;
+	return 0;
+}
+
 static int next_pow2 (int x) {
 	int nx = x;
 	int s = 1;
@@ -672,6 +1700,345 @@ static void (APIENTRY *scale_glViewport)(GLint x, GLint y, GLsizei width, GLsize
 static GLfloat scale_vertex[6] = { -1, -1, 3, -1, -1, 3 };
 static GLfloat scale_texcoord[6] = { 0, 0, 2, 0, 0, 2 };
 
+/* With SDLCL_GL_SCALE=fbo, the application renders into a framebuffer
+ * object in its own context, which is then drawn scaled to the window on
+ * every swap. This avoids switching to a second context and copying out of
+ * the back buffer each frame. Binding framebuffer 0 through the functions
+ * from SDL_GL_GetProcAddress binds this framebuffer instead.
+ */
+static int fbo_cursor_serial;
+static GLfloat fbo_texs, fbo_text, fbo_cursors, fbo_cursort;
+static GLenum fbo_filter;
+static void (APIENTRY *real_glBindFramebuffer)(GLenum target, GLuint framebuffer);
+static void (APIENTRY *real_glBindFramebufferEXT)(GLenum target, GLuint framebuffer);
+
+static struct {
+	void (APIENTRY *ActiveTexture)(GLenum texture);
+	void (APIENTRY *Begin)(GLenum mode);
+	void (APIENTRY *BindBuffer)(GLenum target, GLuint buffer);
+	void (APIENTRY *BindFramebuffer)(GLenum target, GLuint framebuffer);
+	void (APIENTRY *BindRenderbuffer)(GLenum target, GLuint renderbuffer);
+	void (APIENTRY *BindTexture)(GLenum target, GLuint texture);
+	void (APIENTRY *BlitFramebuffer)(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter);
+	void (APIENTRY *BlendFunc)(GLenum sfactor, GLenum dfactor);
+	GLenum (APIENTRY *CheckFramebufferStatus)(GLenum target);
+	void (APIENTRY *Clear)(GLbitfield mask);
+	void (APIENTRY *ClearColor)(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha);
+	void (APIENTRY *Color4f)(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+	void (APIENTRY *ColorMask)(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+	void (APIENTRY *Disable)(GLenum cap);
+	void (APIENTRY *Enable)(GLenum cap);
+	void (APIENTRY *End)(void);
+	void (APIENTRY *FramebufferRenderbuffer)(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+	void (APIENTRY *FramebufferTexture2D)(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+	void (APIENTRY *GenFramebuffers)(GLsizei n, GLuint *framebuffers);
+	void (APIENTRY *GenRenderbuffers)(GLsizei n, GLuint *renderbuffers);
+	void (APIENTRY *GenTextures)(GLsizei n, GLuint *textures);
+	void (APIENTRY *GetIntegerv)(GLenum pname, GLint *params);
+	const GLubyte *(APIENTRY *GetString)(GLenum name);
+	void (APIENTRY *LoadIdentity)(void);
+	void (APIENTRY *MatrixMode)(GLenum mode);
+	void (APIENTRY *Ortho)(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val);
+	void (APIENTRY *PixelStorei)(GLenum pname, GLint param);
+	void (APIENTRY *PolygonMode)(GLenum face, GLenum mode);
+	void (APIENTRY *PopAttrib)(void);
+	void (APIENTRY *PopClientAttrib)(void);
+	void (APIENTRY *PopMatrix)(void);
+	void (APIENTRY *PushAttrib)(GLbitfield mask);
+	void (APIENTRY *PushClientAttrib)(GLbitfield mask);
+	void (APIENTRY *PushMatrix)(void);
+	void (APIENTRY *RenderbufferStorage)(GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+	void (APIENTRY *TexCoord2f)(GLfloat s, GLfloat t);
+	void (APIENTRY *TexEnvi)(GLenum target, GLenum pname, GLint param);
+	void (APIENTRY *TexImage2D)(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels);
+	void (APIENTRY *TexParameteri)(GLenum target, GLenum pname, GLint param);
+	void (APIENTRY *TexSubImage2D)(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels);
+	void (APIENTRY *UseProgram)(GLuint program);
+	void (APIENTRY *Vertex2f)(GLfloat x, GLfloat y);
+	void (APIENTRY *Viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+} fbo_gl;
+
+static void APIENTRY fbo_glBindFramebuffer (GLenum target, GLuint framebuffer) {
+	if (gl_fbo && !framebuffer) framebuffer = fbo_framebuffer;
+	real_glBindFramebuffer(target, framebuffer);
+}
+
+static void APIENTRY fbo_glBindFramebufferEXT (GLenum target, GLuint framebuffer) {
+	if (gl_fbo && !framebuffer) framebuffer = fbo_framebuffer;
+	real_glBindFramebufferEXT(target, framebuffer);
+}
+
+static int want_fbo (void) {
+	const char *env = getenv("SDLCL_GL_SCALE");
+	return env && !strcmp(env, "fbo");
+}
+
+static void *get_fbo_proc (const char *name, const char *suffix) {
+	char buf[64];
+	snprintf(buf, sizeof(buf), "gl%s%s", name, suffix);
+	return rSDL_GL_GetProcAddress(buf);
+}
+
+#define FBO_PROC(name, suffix) if (!(fbo_gl.name = get_fbo_proc(#name, suffix))) return 0;
+
+/* In the sharp scale mode, blits go through a second framebuffer of the
+ * prescaled size, filled with nearest neighbor before the linear blit to
+ * the window. Without it, the screen is scaled with linear filtering only.
+ */
+static void init_fbo_sharp (void) {
+	fbo_sharp_framebuffer = 0;
+	if (scale_mode != SCALE_SHARP || !fbo_gl.BlitFramebuffer) return;
+	if (prescale_width == SDLCL_surface->w && prescale_height == SDLCL_surface->h) return;
+	fbo_gl.GenRenderbuffers(1, &fbo_sharp_renderbuffer);
+	fbo_gl.BindRenderbuffer(GL_RENDERBUFFER, fbo_sharp_renderbuffer);
+	fbo_gl.RenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, prescale_width, prescale_height);
+	fbo_gl.BindRenderbuffer(GL_RENDERBUFFER, 0);
+	fbo_gl.GenFramebuffers(1, &fbo_sharp_framebuffer);
+	fbo_gl.BindFramebuffer(GL_FRAMEBUFFER, fbo_sharp_framebuffer);
+	fbo_gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, fbo_sharp_renderbuffer);
+	/* Incomplete objects go away with the context */
+	if (fbo_gl.CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		fbo_sharp_framebuffer = 0;
+}
+
+static int init_fbo (void) {
+	const char *suffix;
+	const char *version;
+	int major, minor;
+	if (!want_fbo()) return 0;
+	if (rSDL_GL_ExtensionSupported("GL_ARB_framebuffer_object")) suffix = "";
+	else if (rSDL_GL_ExtensionSupported("GL_EXT_framebuffer_object")) suffix = "EXT";
+	else return 0;
+	FBO_PROC(BindFramebuffer, suffix)
+	FBO_PROC(BindRenderbuffer, suffix)
+	FBO_PROC(CheckFramebufferStatus, suffix)
+	FBO_PROC(FramebufferRenderbuffer, suffix)
+	FBO_PROC(FramebufferTexture2D, suffix)
+	FBO_PROC(GenFramebuffers, suffix)
+	FBO_PROC(GenRenderbuffers, suffix)
+	FBO_PROC(RenderbufferStorage, suffix)
+	FBO_PROC(Begin, "")
+	FBO_PROC(BindTexture, "")
+	FBO_PROC(BlendFunc, "")
+	FBO_PROC(Clear, "")
+	FBO_PROC(ClearColor, "")
+	FBO_PROC(Color4f, "")
+	FBO_PROC(ColorMask, "")
+	FBO_PROC(Disable, "")
+	FBO_PROC(Enable, "")
+	FBO_PROC(End, "")
+	FBO_PROC(GenTextures, "")
+	FBO_PROC(GetIntegerv, "")
+	FBO_PROC(GetString, "")
+	FBO_PROC(LoadIdentity, "")
+	FBO_PROC(MatrixMode, "")
+	FBO_PROC(Ortho, "")
+	FBO_PROC(PixelStorei, "")
+	FBO_PROC(PolygonMode, "")
+	FBO_PROC(PopAttrib, "")
+	FBO_PROC(PopClientAttrib, "")
+	FBO_PROC(PopMatrix, "")
+	FBO_PROC(PushAttrib, "")
+	FBO_PROC(PushClientAttrib, "")
+	FBO_PROC(PushMatrix, "")
+	FBO_PROC(TexCoord2f, "")
+	FBO_PROC(TexEnvi, "")
+	FBO_PROC(TexImage2D, "")
+	FBO_PROC(TexParameteri, "")
+	FBO_PROC(TexSubImage2D, "")
+	FBO_PROC(Vertex2f, "")
+	FBO_PROC(Viewport, "")
+	/* These are only needed to undo application state that needs them */
+	version = (const char *)fbo_gl.GetString(GL_VERSION);
+	if (!version || sscanf(version, "%d.%d", &major, &minor) != 2) major = minor = 1;
+	fbo_gl.ActiveTexture = (major > 1 || minor >= 3) ? get_fbo_proc("ActiveTexture", "") : NULL;
+	fbo_gl.UseProgram = major >= 2 ? get_fbo_proc("UseProgram", "") : NULL;
+	fbo_gl.BindBuffer = (major > 2 || (major == 2 && minor >= 1)) ? get_fbo_proc("BindBuffer", "") : NULL;
+	/* Scale with a single blit where possible */
+	if (!*suffix || rSDL_GL_ExtensionSupported("GL_EXT_framebuffer_blit"))
+		fbo_gl.BlitFramebuffer = get_fbo_proc("BlitFramebuffer", suffix);
+	else
+		fbo_gl.BlitFramebuffer = NULL;
+	fbo_filter = (scale_mode == SCALE_NEAREST || scale_mode == SCALE_INTEGER) ? GL_NEAREST : GL_LINEAR;
+
+	fbo_texs = (GLfloat)SDLCL_surface->w / (GLfloat)next_pow2(SDLCL_surface->w);
+	fbo_text = (GLfloat)SDLCL_surface->h / (GLfloat)next_pow2(SDLCL_surface->h);
+	fbo_gl.GenTextures(1, &fbo_texture);
+	fbo_gl.BindTexture(GL_TEXTURE_2D, fbo_texture);
+	fbo_gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, next_pow2(SDLCL_surface->w), next_pow2(SDLCL_surface->h), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	fbo_gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, fbo_filter);
+	fbo_gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, fbo_filter);
+	fbo_gl.BindTexture(GL_TEXTURE_2D, 0);
+	fbo_gl.GenRenderbuffers(1, &fbo_renderbuffer);
+	fbo_gl.BindRenderbuffer(GL_RENDERBUFFER, fbo_renderbuffer);
+	fbo_gl.RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, next_pow2(SDLCL_surface->w), next_pow2(SDLCL_surface->h));
+	fbo_gl.BindRenderbuffer(GL_RENDERBUFFER, 0);
+	fbo_gl.GenFramebuffers(1, &fbo_framebuffer);
+	fbo_gl.BindFramebuffer(GL_FRAMEBUFFER, fbo_framebuffer);
+	fbo_gl.FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo_texture, 0);
+	fbo_gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, fbo_renderbuffer);
+	fbo_gl.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, fbo_renderbuffer);
+	if (fbo_gl.CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		/* The objects go away with the context */
+		fbo_gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+		return 0;
+	}
+	init_fbo_sharp();
+	fbo_gl.BindFramebuffer(GL_FRAMEBUFFER, fbo_framebuffer);
+	fbo_gl.Viewport(0, 0, SDLCL_surface->w, SDLCL_surface->h);
+	fbo_cursor = 0;
+	gl_fbo = 1;
+	return 1;
+}
+
+/* Upload the cursor image again if SDL_SetCursor changed it */
+static void update_fbo_cursor (const SDL1_Cursor *cursor) {
+	int texw, texh;
+	if (fbo_cursor && fbo_cursor_serial == SDLCL_cursor_serial) {
+		fbo_gl.BindTexture(GL_TEXTURE_2D, fbo_cursor);
+		return;
+	}
+	texw = next_pow2(cursor->area.w);
+	texh = next_pow2(cursor->area.h);
+	if (!fbo_cursor) fbo_gl.GenTextures(1, &fbo_cursor);
+	fbo_gl.BindTexture(GL_TEXTURE_2D, fbo_cursor);
+	if (fbo_gl.BindBuffer) fbo_gl.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	fbo_gl.PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	fbo_gl.PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	fbo_gl.PixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	fbo_gl.PixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	fbo_gl.TexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, texw, texh, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, NULL);
+	fbo_gl.TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, cursor->area.w, cursor->area.h, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, cursor->image);
+	fbo_gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	fbo_gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	fbo_cursors = (GLfloat)cursor->area.w / (GLfloat)texw;
+	fbo_cursort = (GLfloat)cursor->area.h / (GLfloat)texh;
+	fbo_cursor_serial = SDLCL_cursor_serial;
+}
+
+static void fbo_quad (GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1, GLfloat s, GLfloat t) {
+	fbo_gl.Begin(GL_QUADS);
+	fbo_gl.TexCoord2f(0, 0);
+	fbo_gl.Vertex2f(x0, y0);
+	fbo_gl.TexCoord2f(s, 0);
+	fbo_gl.Vertex2f(x1, y0);
+	fbo_gl.TexCoord2f(s, t);
+	fbo_gl.Vertex2f(x1, y1);
+	fbo_gl.TexCoord2f(0, t);
+	fbo_gl.Vertex2f(x0, y1);
+	fbo_gl.End();
+}
+
+/* Set up the fixed-function state for drawing textured quads, keeping the
+ * application's state to put back afterwards
+ */
+static void push_fbo_state (GLint *program) {
+	static const GLenum caps[] = {
+		GL_ALPHA_TEST, GL_BLEND, GL_COLOR_LOGIC_OP, GL_CULL_FACE, GL_DEPTH_TEST,
+		GL_DITHER, GL_FOG, GL_LIGHTING, GL_SCISSOR_TEST, GL_STENCIL_TEST,
+		GL_TEXTURE_1D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP,
+		GL_TEXTURE_GEN_S, GL_TEXTURE_GEN_T, GL_TEXTURE_GEN_R, GL_TEXTURE_GEN_Q
+	};
+	int i;
+	*program = 0;
+	if (fbo_gl.UseProgram) {
+		fbo_gl.GetIntegerv(GL_CURRENT_PROGRAM, program);
+		if (*program) fbo_gl.UseProgram(0);
+	}
+	fbo_gl.PushAttrib(GL_ALL_ATTRIB_BITS);
+	fbo_gl.PushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
+	if (fbo_gl.ActiveTexture) fbo_gl.ActiveTexture(GL_TEXTURE0);
+	fbo_gl.MatrixMode(GL_TEXTURE);
+	fbo_gl.PushMatrix();
+	fbo_gl.LoadIdentity();
+	fbo_gl.MatrixMode(GL_MODELVIEW);
+	fbo_gl.PushMatrix();
+	fbo_gl.LoadIdentity();
+	fbo_gl.MatrixMode(GL_PROJECTION);
+	fbo_gl.PushMatrix();
+	for (i = 0; i < (int)(sizeof(caps) / sizeof(caps[0])); i++) fbo_gl.Disable(caps[i]);
+	fbo_gl.Enable(GL_TEXTURE_2D);
+	fbo_gl.TexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	fbo_gl.PolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	fbo_gl.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	fbo_gl.Color4f(1, 1, 1, 1);
+}
+
+static void pop_fbo_state (GLint program) {
+	fbo_gl.PopMatrix();
+	fbo_gl.MatrixMode(GL_MODELVIEW);
+	fbo_gl.PopMatrix();
+	fbo_gl.MatrixMode(GL_TEXTURE);
+	fbo_gl.PopMatrix();
+	fbo_gl.PopClientAttrib();
+	fbo_gl.PopAttrib();
+	if (program) fbo_gl.UseProgram(program);
+}
+
+static void fbo_scale (void) {
+	SDL1_Cursor *cursor = NULL;
+	GLint draw_framebuffer, read_framebuffer = 0, program = 0;
+	int x, y, pushed = 0;
+	fbo_gl.GetIntegerv(GL_FRAMEBUFFER_BINDING, &draw_framebuffer);
+	if (SDL_ShowCursor(SDL1_QUERY)) cursor = SDL_GetCursor();
+	/* A plain blit needs none of the drawing state */
+	if (cursor || !fbo_gl.BlitFramebuffer) {
+		push_fbo_state(&program);
+		pushed = 1;
+	}
+	if (cursor) {
+		SDL_GetMouseState(&x, &y);
+		x -= cursor->hot_x;
+		y -= cursor->hot_y;
+		fbo_gl.BindFramebuffer(GL_FRAMEBUFFER, fbo_framebuffer);
+		fbo_gl.Viewport(0, 0, SDLCL_surface->w, SDLCL_surface->h);
+		fbo_gl.LoadIdentity();
+		fbo_gl.Ortho(0, SDLCL_surface->w, SDLCL_surface->h, 0, -1, 1);
+		fbo_gl.Enable(GL_BLEND);
+		fbo_gl.BlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+		update_fbo_cursor(cursor);
+		fbo_quad(x, y, x + cursor->area.w, y + cursor->area.h, fbo_cursors, fbo_cursort);
+		fbo_gl.Disable(GL_BLEND);
+	}
+	if (fbo_gl.BlitFramebuffer) {
+		fbo_gl.GetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+		if (!pushed) {
+			fbo_gl.PushAttrib(GL_COLOR_BUFFER_BIT | GL_SCISSOR_BIT);
+			fbo_gl.Disable(GL_SCISSOR_TEST);
+			fbo_gl.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		}
+		fbo_gl.BindFramebuffer(GL_READ_FRAMEBUFFER, fbo_framebuffer);
+		if (fbo_sharp_framebuffer) {
+			fbo_gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo_sharp_framebuffer);
+			fbo_gl.BlitFramebuffer(0, 0, SDLCL_surface->w, SDLCL_surface->h,
+				0, 0, prescale_width, prescale_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			fbo_gl.BindFramebuffer(GL_READ_FRAMEBUFFER, fbo_sharp_framebuffer);
+		}
+		fbo_gl.BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		fbo_gl.ClearColor(0, 0, 0, 0);
+		fbo_gl.Clear(GL_COLOR_BUFFER_BIT);
+		fbo_gl.BlitFramebuffer(0, 0,
+			fbo_sharp_framebuffer ? prescale_width : SDLCL_surface->w,
+			fbo_sharp_framebuffer ? prescale_height : SDLCL_surface->h,
+			SDLCL_scale_rect.x, SDLCL_scale_rect.y,
+			SDLCL_scale_rect.x + SDLCL_scale_rect.w, SDLCL_scale_rect.y + SDLCL_scale_rect.h,
+			GL_COLOR_BUFFER_BIT, fbo_filter);
+		if (!pushed) fbo_gl.PopAttrib();
+	} else {
+		fbo_gl.BindFramebuffer(GL_FRAMEBUFFER, 0);
+		fbo_gl.ClearColor(0, 0, 0, 0);
+		fbo_gl.Clear(GL_COLOR_BUFFER_BIT);
+		fbo_gl.Viewport(SDLCL_scale_rect.x, SDLCL_scale_rect.y, SDLCL_scale_rect.w, SDLCL_scale_rect.h);
+		fbo_gl.LoadIdentity();
+		fbo_gl.Ortho(0, 1, 0, 1, -1, 1);
+		fbo_gl.BindTexture(GL_TEXTURE_2D, fbo_texture);
+		fbo_quad(0, 0, 1, 1, fbo_texs, fbo_text);
+	}
+	if (pushed) pop_fbo_state(program);
+	fbo_gl.BindFramebuffer(GL_FRAMEBUFFER, draw_framebuffer);
+	if (fbo_gl.BlitFramebuffer) fbo_gl.BindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+}
+
 static int init_scale (void) {
 	void (APIENTRY *scale_glBindTexture)(GLenum target, GLuint texture);
 	void (APIENTRY *scale_glBlendFunc)(GLenum sfactor, GLenum dfactor);
@@ -685,15 +2052,28 @@ static int init_scale (void) {
 	void (APIENTRY *scale_glTexParameteri)(GLenum target, GLenum pname, GLint param);
 	void (APIENTRY *scale_glVertexPointer)(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer);
 	void (APIENTRY *main_glViewport)(GLint x, GLint y, GLsizei width, GLsizei height);
-	int texw, texh;
+	int texw, texh, factor;
+	GLint filter;
 	GLuint scale_texture;
 	void *texp;
 	SDLCL_scale_rect.w = (SDLCL_surface->w * real_height) / SDLCL_surface->h;
 	SDLCL_scale_rect.h = (SDLCL_surface->h * real_width) / SDLCL_surface->w;
 	if (SDLCL_scale_rect.w > real_width) SDLCL_scale_rect.w = real_width;
 	else SDLCL_scale_rect.h = real_height;
+	/* Largest whole multiple of the screen size that fits the window */
+	factor = real_width / SDLCL_surface->w;
+	if (real_height / SDLCL_surface->h < factor) factor = real_height / SDLCL_surface->h;
+	if (factor < 1) factor = 1;
+	if (scale_mode == SCALE_INTEGER && factor * SDLCL_surface->w <= real_width &&
+		factor * SDLCL_surface->h <= real_height) {
+		SDLCL_scale_rect.w = factor * SDLCL_surface->w;
+		SDLCL_scale_rect.h = factor * SDLCL_surface->h;
+	}
+	prescale_width = factor * SDLCL_surface->w;
+	prescale_height = factor * SDLCL_surface->h;
 	SDLCL_scale_rect.x = (real_width - SDLCL_scale_rect.w) / 2;
 	SDLCL_scale_rect.y = (real_height - SDLCL_scale_rect.h) / 2;
+	if ((mode_flags & SDL1_OPENGL) && init_fbo()) return 1;
 	if (mode_flags & SDL1_OPENGL) {
 		texw = next_pow2(SDLCL_surface->w);
 		texh = next_pow2(SDLCL_surface->h);
@@ -754,8 +2134,9 @@ static int init_scale (void) {
 		scale_glGenTextures(1, &scale_texture);
 		scale_glBindTexture(GL_TEXTURE_2D, scale_texture);
 		scale_glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, texw, texh, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, texp);
-		scale_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		scale_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		filter = (scale_mode == SCALE_NEAREST || scale_mode == SCALE_INTEGER) ? GL_NEAREST : GL_LINEAR;
+		scale_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		scale_glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
 		scale_glVertexPointer(2, GL_FLOAT, 0, &scale_vertex);
 		scale_glTexCoordPointer(2, GL_FLOAT, 0, &scale_texcoord);
 		scale_glEnableClientState(GL_VERTEX_ARRAY);
@@ -813,6 +2194,7 @@ DECLSPEC SDL1_Surface *SDLCALL SDL_SetVideoMode (int width, int height, int bpp,
 	rSDL_PixelFormatEnumToMasks(pixfmt, &bpp, &Rmask, &Gmask, &Bmask, &Amask);
 	Amask = 0;
 	close_window();
+	init_scale_mode();
 	if (flags & SDL1_OPENGL) {
 		/* Use compatibility profile for OpenGL */
 		rSDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_COMPATIBILITY);
@@ -829,17 +2211,10 @@ DECLSPEC SDL1_Surface *SDLCALL SDL_SetVideoMode (int width, int height, int bpp,
 			return NULL;
 		}
 	} else {
-		SDLCL_renderer = rSDL_CreateRenderer(SDLCL_window, -1, 0);
-		if (!SDLCL_renderer) {
-			close_window();
-			return NULL;
-		}
-		rSDL_SetRenderDrawColor(SDLCL_renderer, 0, 0, 0, 255);
-		rSDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
 		if (bpp > 8) {
-			main_texture = rSDL_CreateTexture(SDLCL_renderer, pixfmt, SDL_TEXTUREACCESS_STREAMING, width, height);
+			screen_texfmt = pixfmt;
 		} else {
-			main_texture = rSDL_CreateTexture(SDLCL_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+			screen_texfmt = SDL_PIXELFORMAT_ARGB8888;
 			rSDL_PixelFormatEnumToMasks(SDL_PIXELFORMAT_ARGB8888,
 				&tbpp,
 				&texture_format.Rmask,
@@ -851,14 +2226,17 @@ DECLSPEC SDL1_Surface *SDLCALL SDL_SetVideoMode (int width, int height, int bpp,
 			texture_format.BytesPerPixel = tbpp / 8;
 			process_masks(&texture_format);
 			memset(physical_palette, 0, sizeof(Uint32) * 256);
+			palette_dirty = 0;
+			init_expand_palette();
 		}
-		if (!main_texture) {
+		if (start_present_thread(width, height) && open_renderer(width, height)) {
 			close_window();
 			return NULL;
 		}
-		rSDL_SetTextureBlendMode(main_texture, SDL_BLENDMODE_NONE);
 	}
-	SDLCL_surface = SDL_CreateRGBSurface(0, width, height, bpp, Rmask, Gmask, Bmask, Amask);
+	zero_copy = 0;
+	if (SDLCL_renderer && !present_thread) SDLCL_surface = create_mapped_screen(pixfmt, width, height, bpp, Rmask, Gmask, Bmask, Amask);
+	if (!SDLCL_surface) SDLCL_surface = SDL_CreateRGBSurface(0, width, height, bpp, Rmask, Gmask, Bmask, Amask);
 	if (!SDLCL_surface) {
 		close_window();
 		return NULL;
@@ -874,6 +2252,8 @@ DECLSPEC SDL1_Surface *SDLCALL SDL_SetVideoMode (int width, int height, int bpp,
 			return NULL;
 		}
 	}
+	if (SDLCL_renderer && !zero_copy) init_tiles();
+	init_defer();
 	SDLCL_SetMouseRange(width, height);
 	SDLCL_UpdateGrab();
 	SDL_SetCursor(NULL);
@@ -905,6 +2285,7 @@ DECLSPEC int SDLCALL SDL_SetPalette (SDL1_Surface *surface, int flags, SDL1_Colo
 		if (firstcolor > 256 - ncolors) return 0;
 		for (i = 0; i < ncolors; i++)
 			physical_palette[firstcolor + i] = SDL_MapRGB(&texture_format, colors[i].r, colors[i].g, colors[i].b);
+		if (surface->format->BitsPerPixel == 8) palette_dirty = 1;
 	}
 	return 1;
 }
@@ -913,47 +2294,82 @@ DECLSPEC int SDLCALL SDL_SetColors (SDL1_Surface *surface, SDL1_Color *colors, i
 	return SDL_SetPalette(surface, SDL1_LOGPAL | SDL1_PHYSPAL, colors, firstcolor, ncolors);
 }
 
+/* Blit a whole surface with its color key and alpha only applied where a
+ * conversion to dst keeps them. The blit goes through a temporary surface
+ * sharing the source pixels, so the source's own blit state is untouched.
+ */
+static int convert_blit (SDL1_Surface *src, SDL1_Surface *dst, int keep_key, int keep_alpha) {
+	SDL_Surface *src2 = src->sdl2_surface;
+	SDL_Surface *view;
+	SDL_Rect rect;
+	blit_state cur, want;
+	int ret;
+	if (SDL_LockSurface(src)) return -1;
+	view = rSDL_CreateRGBSurfaceFrom(src2->pixels, src2->w, src2->h, src2->format->BitsPerPixel, src2->pitch,
+		src2->format->Rmask, src2->format->Gmask, src2->format->Bmask, src2->format->Amask);
+	if (!view) {
+		SDL_UnlockSurface(src);
+		return -1;
+	}
+	if (src2->format->palette) rSDL_SetSurfacePalette(view, src2->format->palette);
+	/* State of a new surface, see SDL_CreateRGBSurfaceFrom() */
+	cur.rle = 0;
+	cur.blend = src2->format->Amask ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE;
+	cur.alphamod = 255;
+	cur.keyed = 0;
+	cur.key = 0;
+	want = ((SDL1_Proxy *)src)->blit;
+	want.rle = 0;
+	if (!keep_key) want.keyed = 0;
+	if (!keep_alpha) {
+		want.blend = SDL_BLENDMODE_NONE;
+		want.alphamod = 255;
+	}
+	apply_blit_state(view, &cur, &want);
+	rect.x = rect.y = 0;
+	rect.w = src->w;
+	rect.h = src->h;
+	ret = rSDL_LowerBlit(view, &rect, dst->sdl2_surface, &rect);
+	rSDL_FreeSurface(view);
+	SDL_UnlockSurface(src);
+	return ret;
+}
+
 static void convert_surface_dst (SDL1_Surface *src, SDL1_Surface *dst) {
-	Uint32 colorkey = 0;
-	Uint8 kr, kg, kb, alpha = 0;
-	Uint32 srcflags;
-	SDL1_Rect rect = { 0, 0, src->w, src->h };
-	srcflags = src->flags;
+	Uint8 kr, kg, kb;
+	Uint32 srcflags = src->flags;
+	int keep_key = 0, keep_alpha = 0;
 	if (srcflags & SDL1_SRCCOLORKEY) {
 		if (!(dst->flags & SDL1_SRCCOLORKEY) && dst->format->Amask) {
+			/* Keyed pixels become transparent */
 			srcflags &= ~SDL1_SRCCOLORKEY;
-		} else {
-			colorkey = src->format->colorkey;
-			SDL_SetColorKey(src, 0, 0);
+			keep_key = 1;
 		}
 	}
 	if (srcflags & SDL1_SRCALPHA) {
 		if (dst->format->Amask) {
 			srcflags &= ~SDL1_SRCALPHA;
-		} else {
-			alpha = src->format->alpha;
-			SDL_SetAlpha(src, 0, 0);
+			keep_alpha = 1;
 		}
 	}
-	SDL_LowerBlit(src, &rect, dst, &rect);
+	convert_blit(src, dst, keep_key, keep_alpha);
 	SDL_SetClipRect(dst, &src->clip_rect);
 	if (srcflags & SDL1_SRCCOLORKEY) {
-		SDL_GetRGB(colorkey, src->format, &kr, &kg, &kb);
+		SDL_GetRGB(src->format->colorkey, src->format, &kr, &kg, &kb);
 		SDL_SetColorKey(dst, srcflags & (SDL1_SRCCOLORKEY | SDL1_RLEACCEL), SDL_MapRGB(dst->format, kr, kg, kb));
-		SDL_SetColorKey(src, srcflags & (SDL1_SRCCOLORKEY | SDL1_RLEACCEL), colorkey);
-	}
-	if (srcflags & SDL1_SRCALPHA) {
-		SDL_SetAlpha(dst, srcflags & (SDL1_SRCALPHA | SDL1_RLEACCEL), alpha);
-		SDL_SetAlpha(src, srcflags & (SDL1_SRCALPHA | SDL1_RLEACCEL), alpha);
 	}
+	if (srcflags & SDL1_SRCALPHA)
+		SDL_SetAlpha(dst, srcflags & (SDL1_SRCALPHA | SDL1_RLEACCEL), src->format->alpha);
 }
 
 DECLSPEC SDL1_Surface *SDLCALL SDL_ConvertSurface (SDL1_Surface *src, SDL1_PixelFormat *fmt, Uint32 flags) {
 	SDL1_Surface *dst;
+	Uint64 start = SDLCL_StatStart();
 	dst = SDL_CreateRGBSurface(flags, src->w, src->h, fmt->BitsPerPixel, fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask);
 	if (!dst) return NULL;
 	if (fmt->palette) SDL_SetColors(dst, fmt->palette->colors, 0, fmt->palette->ncolors);
 	convert_surface_dst(src, dst);
+	SDLCL_StatEnd(SDLCL_STAT_CONVERT, start);
 	return dst;
 }
 
@@ -966,65 +2382,653 @@ DECLSPEC SDL1_Surface *SDL_DisplayFormatAlpha (SDL1_Surface *surface) {
 	int depth;
 	Uint32 Rmask, Gmask, Bmask, Amask;
 	SDL1_Surface *dst;
+	Uint64 start = SDLCL_StatStart();
 	rSDL_PixelFormatEnumToMasks(SDL_PIXELFORMAT_ARGB8888, &depth, &Rmask, &Gmask, &Bmask, &Amask);
 	dst = SDL_CreateRGBSurface(0, surface->w, surface->h, depth, Rmask, Gmask, Bmask, Amask);
 	if (!dst) return NULL;
 	convert_surface_dst(surface, dst);
+	SDLCL_StatEnd(SDLCL_STAT_CONVERT, start);
 	return dst;
 }
 
-DECLSPEC int SDLCALL SDL_Flip (SDL1_Surface *screen) {
-	Uint8 *src;
-	Uint32 *dest;
-	void *texpix;
-	int texpitch, i, j;
-	(void)screen;
-	if (!SDLCL_renderer) return 0;
-	if (SDL_LockSurface(SDLCL_surface)) return -1;
-	if (rSDL_LockTexture(main_texture, NULL, &texpix, &texpitch)) {
-		SDL_UnlockSurface(SDLCL_surface);
-		return -1;
+DECLSPEC void SDLCALL SDLCL_GetVideoStats (SDLCL_VideoStats *stats) {
+	if (present_thread) rSDL_LockMutex(present_lock);
+	*stats = video_stats;
+	if (present_thread) rSDL_UnlockMutex(present_lock);
+}
+
+DECLSPEC void SDLCALL SDLCL_ResetVideoStats (void) {
+	if (present_thread) rSDL_LockMutex(present_lock);
+	memset(&video_stats, 0, sizeof(video_stats));
+	if (present_thread) rSDL_UnlockMutex(present_lock);
+}
+
+/* Uploads at least this big bypass the cache, so that pushing a frame out to
+ * the renderer doesn't evict the application's working set.
+ */
+#define STREAM_THRESHOLD (512 * 1024)
+
+#ifdef SDLCL_X86_SIMD
+__attribute__((target("sse2")))
+static void stream_copy (Uint8 *dst, const Uint8 *src, size_t len) {
+	size_t head = (16 - ((size_t)dst & 15)) & 15;
+	if (head > len) head = len;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	len -= head;
+	for (; len >= 64; len -= 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+		_mm_stream_si128((__m128i *)dst, a);
+		_mm_stream_si128((__m128i *)(dst + 16), b);
+		_mm_stream_si128((__m128i *)(dst + 32), c);
+		_mm_stream_si128((__m128i *)(dst + 48), d);
+		dst += 64;
+		src += 64;
+	}
+	for (; len >= 16; len -= 16) {
+		_mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+		dst += 16;
+		src += 16;
+	}
+	memcpy(dst, src, len);
+}
+#endif
+
+/* Copy a block of rows, picking the cheapest way the layout allows */
+static void copy_rows (Uint8 *dst, int dstpitch, const Uint8 *src, int srcpitch, int rowbytes, int rows) {
+	int contiguous = (dstpitch == rowbytes && srcpitch == rowbytes);
+	int i;
+	upload_stats->bytes += (Uint64)rowbytes * rows;
+#ifdef SDLCL_X86_SIMD
+	if ((size_t)rowbytes * rows >= STREAM_THRESHOLD && SDLCL_GetSIMDLevel() >= SDLCL_SIMD_SSE2) {
+		if (contiguous) {
+			stream_copy(dst, src, (size_t)rowbytes * rows);
+		} else {
+			for (i = 0; i < rows; i++)
+				stream_copy(dst + i * dstpitch, src + i * srcpitch, rowbytes);
+		}
+		_mm_sfence();
+		upload_stats->streamed++;
+		return;
 	}
+#endif
+	if (contiguous) {
+		memcpy(dst, src, (size_t)rowbytes * rows);
+		upload_stats->contiguous++;
+	} else {
+		for (i = 0; i < rows; i++)
+			memcpy(dst + i * dstpitch, src + i * srcpitch, rowbytes);
+		upload_stats->rows++;
+	}
+}
+
+/* Copy a region of a frame laid out like the screen surface into the
+ * streaming texture
+ */
+static int upload_rect (const SDL_Rect *rect, const Uint8 *pixels, int pitch, const Uint32 *palette) {
+	const Uint8 *src;
+	void *texpix;
+	int texpitch, i;
+	if (rSDL_LockTexture(main_texture, rect, &texpix, &texpitch)) return -1;
+	src = pixels + rect->y * pitch + rect->x * SDLCL_surface->format->BytesPerPixel;
 	if (SDLCL_surface->format->BitsPerPixel > 8) {
-		for (i = 0; i < SDLCL_surface->h; i++)
-			memcpy(((Uint8 *)texpix) + i * texpitch,
-				SDLCL_surface->pixels + i * SDLCL_surface->pitch,
-				SDLCL_surface->w * SDLCL_surface->format->BytesPerPixel);
+		copy_rows(texpix, texpitch, src, pitch,
+			rect->w * SDLCL_surface->format->BytesPerPixel, rect->h);
 	} else {
-		for (i = 0; i < SDLCL_surface->h; i++) {
-			src = SDLCL_surface->pixels + i * SDLCL_surface->pitch;
-			dest = (Uint32 *)(((Uint8 *)texpix) + i * texpitch);
-			for (j = 0; j < SDLCL_surface->w; j++)
-				dest[j] = physical_palette[src[j]];
+		for (i = 0; i < rect->h; i++) {
+			expand_palette((Uint32 *)(((Uint8 *)texpix) + i * texpitch), src, palette, rect->w);
+			src += pitch;
 		}
+		upload_stats->expanded++;
+		upload_stats->bytes += (Uint64)rect->w * rect->h * 4;
 	}
-	/* TODO: Draw mouse cursor when scaling */
 	rSDL_UnlockTexture(main_texture);
-	SDL_UnlockSurface(SDLCL_surface);
+	return 0;
+}
+
+/* Called on the application's thread. The image is only copied again
+ * after the cursor has changed.
+ */
+static void capture_cursor (cursor_shot *shot) {
+	SDL1_Cursor *cursor;
+	Uint8 *image;
+	size_t size;
+	int x, y;
+	shot->visible = 0;
+	if (!SDLCL_scaling || !SDL_ShowCursor(SDL1_QUERY)) return;
+	cursor = SDL_GetCursor();
+	if (!cursor) return;
+	if (!shot->image || shot->serial != SDLCL_cursor_serial) {
+		size = (size_t)cursor->area.w * cursor->area.h * 2;
+		image = realloc(shot->image, size ? size : 1);
+		if (!image) return;
+		memcpy(image, cursor->image, size);
+		shot->image = image;
+		shot->w = cursor->area.w;
+		shot->h = cursor->area.h;
+		shot->serial = SDLCL_cursor_serial;
+	}
+	SDL_GetMouseState(&x, &y);
+	shot->x = x - cursor->hot_x;
+	shot->y = y - cursor->hot_y;
+	shot->visible = 1;
+}
+
+/* Build the texture for the cursor image, which holds luminance and alpha
+ * pairs like the ones drawn by the GL path
+ */
+static SDL_Texture *get_cursor_texture (const cursor_shot *shot) {
+	Uint32 *pixels;
+	const Uint8 *src;
+	int i, n;
+	if (cursor_texture && cursor_texture_serial == shot->serial) return cursor_texture;
+	if (cursor_texture) {
+		rSDL_DestroyTexture(cursor_texture);
+		cursor_texture = NULL;
+	}
+	n = shot->w * shot->h;
+	pixels = malloc(n * sizeof(Uint32));
+	if (!pixels) return NULL;
+	src = shot->image;
+	for (i = 0; i < n; i++, src += 2)
+		pixels[i] = ((Uint32)src[1] << 24) | (src[0] * 0x010101);
+	cursor_texture = rSDL_CreateTexture(SDLCL_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, shot->w, shot->h);
+	if (cursor_texture) {
+		rSDL_UpdateTexture(cursor_texture, NULL, pixels, shot->w * sizeof(Uint32));
+		rSDL_SetTextureBlendMode(cursor_texture, SDL_BLENDMODE_BLEND);
+		cursor_texture_serial = shot->serial;
+	}
+	free(pixels);
+	return cursor_texture;
+}
+
+/* The system cursor is hidden while scaling, so draw it over the scaled
+ * frame at the size it has relative to the screen surface
+ */
+static void draw_cursor (const cursor_shot *shot) {
+	SDL_Texture *texture;
+	SDL_Rect dest;
+	if (!shot->visible) return;
+	texture = get_cursor_texture(shot);
+	if (!texture) return;
+	dest.x = shot->x * SDLCL_scale_rect.w / SDLCL_virtual_width + SDLCL_scale_rect.x;
+	dest.y = shot->y * SDLCL_scale_rect.h / SDLCL_virtual_height + SDLCL_scale_rect.y;
+	dest.w = (shot->x + shot->w) * SDLCL_scale_rect.w / SDLCL_virtual_width + SDLCL_scale_rect.x - dest.x;
+	dest.h = (shot->y + shot->h) * SDLCL_scale_rect.h / SDLCL_virtual_height + SDLCL_scale_rect.y - dest.y;
+	rSDL_RenderCopy(SDLCL_renderer, texture, NULL, &dest);
+}
+
+/* In the sharp scale mode, the screen is first blown up by a whole factor
+ * with nearest neighbor into a render target, which is then stretched the
+ * rest of the way with linear filtering. Without render targets this
+ * degrades to nearest neighbor.
+ */
+static SDL_Texture *prescale_screen (void) {
+	if (scale_mode != SCALE_SHARP || prescale_failed) return main_texture;
+	if (!prescale_texture) {
+		if (rSDL_RenderTargetSupported(SDLCL_renderer)) {
+			rSDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
+			prescale_texture = rSDL_CreateTexture(SDLCL_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, prescale_width, prescale_height);
+			rSDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+		}
+		if (!prescale_texture) {
+			prescale_failed = 1;
+			return main_texture;
+		}
+		rSDL_SetTextureBlendMode(prescale_texture, SDL_BLENDMODE_NONE);
+	}
+	if (rSDL_SetRenderTarget(SDLCL_renderer, prescale_texture)) return main_texture;
+	rSDL_RenderCopy(SDLCL_renderer, main_texture, NULL, NULL);
+	rSDL_SetRenderTarget(SDLCL_renderer, NULL);
+	return prescale_texture;
+}
+
+static void present_screen (const cursor_shot *cursor) {
+	SDL_Texture *texture = SDLCL_scaling ? prescale_screen() : main_texture;
 	rSDL_RenderClear(SDLCL_renderer);
-	if (SDLCL_scaling)
-		rSDL_RenderCopy(SDLCL_renderer, main_texture, NULL, &SDLCL_scale_rect);
-	else
+	if (SDLCL_scaling) {
+		rSDL_RenderCopy(SDLCL_renderer, texture, NULL, &SDLCL_scale_rect);
+		draw_cursor(cursor);
+	} else {
 		rSDL_RenderCopy(SDLCL_renderer, main_texture, NULL, NULL);
+	}
 	rSDL_RenderPresent(SDLCL_renderer);
+}
+
+/* Upload the tiles of a region that differ from the last upload, joining
+ * changed tiles that are next to each other into one upload
+ */
+static int upload_changed (const SDL_Rect *rect, const Uint8 *pixels, int pitch, const Uint32 *palette) {
+	SDL_Rect run;
+	size_t offset;
+	int bytespp = SDLCL_surface->format->BytesPerPixel;
+	int tx, ty, x0, x1, y0, y1, y, full;
+	Uint8 *stale;
+	if (!tile_size) return upload_rect(rect, pixels, pitch, palette);
+	if (bytespp == 1 && memcmp(tile_palette, palette, sizeof(tile_palette))) {
+		/* Everything on screen has to be expanded again */
+		memcpy(tile_palette, palette, sizeof(tile_palette));
+		memset(tile_stale, 1, tiles_across * tiles_down);
+	}
+	for (ty = rect->y / tile_size; ty * tile_size < rect->y + rect->h; ty++) {
+		y0 = ty * tile_size > rect->y ? ty * tile_size : rect->y;
+		y1 = (ty + 1) * tile_size < rect->y + rect->h ? (ty + 1) * tile_size : rect->y + rect->h;
+		run.w = 0;
+		for (tx = rect->x / tile_size; tx * tile_size < rect->x + rect->w; tx++) {
+			x0 = tx * tile_size > rect->x ? tx * tile_size : rect->x;
+			x1 = (tx + 1) * tile_size < rect->x + rect->w ? (tx + 1) * tile_size : rect->x + rect->w;
+			stale = &tile_stale[ty * tiles_across + tx];
+			offset = y0 * pitch + x0 * bytespp;
+			y = y0;
+			if (!*stale) {
+				for (; y < y1; y++, offset += pitch)
+					if (memcmp(tile_shadow + offset, pixels + offset, (x1 - x0) * bytespp)) break;
+			}
+			if (y == y1) {
+				upload_stats->tiles_skipped++;
+				if (run.w && upload_rect(&run, pixels, pitch, palette)) return -1;
+				run.w = 0;
+				continue;
+			}
+			for (; y < y1; y++, offset += pitch)
+				memcpy(tile_shadow + offset, pixels + offset, (x1 - x0) * bytespp);
+			/* A tile only partly inside the region may still be stale elsewhere */
+			full = x0 == tx * tile_size && y0 == ty * tile_size &&
+				(x1 == x0 + tile_size || x1 == SDLCL_surface->w) &&
+				(y1 == y0 + tile_size || y1 == SDLCL_surface->h);
+			if (full) *stale = 0;
+			upload_stats->tiles_uploaded++;
+			if (run.w) {
+				run.w = x1 - run.x;
+			} else {
+				run.x = x0;
+				run.y = y0;
+				run.w = x1 - x0;
+				run.h = y1 - y0;
+			}
+		}
+		if (run.w && upload_rect(&run, pixels, pitch, palette)) return -1;
+	}
+	return 0;
+}
+
+static int upload_screen_rect (const SDL_Rect *rect) {
+	return upload_changed(rect, SDLCL_surface->pixels, SDLCL_surface->pitch, physical_palette);
+}
+
+/* Clip an update rectangle to the screen, returns 0 if nothing is left */
+static int clip_update_rect (SDL_Rect *rect) {
+	if (rect->x < 0) {
+		rect->w += rect->x;
+		rect->x = 0;
+	}
+	if (rect->y < 0) {
+		rect->h += rect->y;
+		rect->y = 0;
+	}
+	if (rect->x + rect->w > SDLCL_surface->w) rect->w = SDLCL_surface->w - rect->x;
+	if (rect->y + rect->h > SDLCL_surface->h) rect->h = SDLCL_surface->h - rect->y;
+	return rect->w > 0 && rect->h > 0;
+}
+
+static void union_rect (SDL_Rect *a, const SDL_Rect *b) {
+	int x2 = a->x + a->w, y2 = a->y + a->h;
+	if (b->x + b->w > x2) x2 = b->x + b->w;
+	if (b->y + b->h > y2) y2 = b->y + b->h;
+	if (b->x < a->x) a->x = b->x;
+	if (b->y < a->y) a->y = b->y;
+	a->w = x2 - a->x;
+	a->h = y2 - a->y;
+}
+
+/* Add a rectangle to a dirty list, merging it with any rectangles that can
+ * be combined without uploading more pixels than uploading both separately.
+ * If the list fills up, everything collapses into one bounding rectangle.
+ */
+static void merge_rect (SDL_Rect *list, int *num, const SDL_Rect *rect) {
+	SDL_Rect r = *rect, u;
+	int i;
+	i = 0;
+	while (i < *num) {
+		u = list[i];
+		union_rect(&u, &r);
+		if (u.w * u.h <= list[i].w * list[i].h + r.w * r.h) {
+			r = u;
+			list[i] = list[--*num];
+			i = 0;
+		} else {
+			i++;
+		}
+	}
+	if (*num == MAX_DIRTY_RECTS) {
+		for (i = 1; i < *num; i++)
+			union_rect(&list[0], &list[i]);
+		union_rect(&list[0], &r);
+		*num = 1;
+	} else {
+		list[(*num)++] = r;
+	}
+}
+
+/* With SDLCL_PRESENT_THREAD set to 2 or 3, the screen is presented by a
+ * separate thread that creates and owns the renderer. Screen updates copy
+ * their dirty rectangles into one of that many staging buffers and return
+ * without waiting for the upload or for vsync. When no buffer is free, the
+ * update is merged into the most recently queued frame instead.
+ */
+/* Called by the presenter thread with present_lock held */
+static void publish_present_stats (void) {
+	video_stats.rows += present_stats.rows;
+	video_stats.contiguous += present_stats.contiguous;
+	video_stats.streamed += present_stats.streamed;
+	video_stats.expanded += present_stats.expanded;
+	video_stats.tiles_uploaded += present_stats.tiles_uploaded;
+	video_stats.tiles_skipped += present_stats.tiles_skipped;
+	video_stats.bytes += present_stats.bytes;
+	memset(&present_stats, 0, sizeof(present_stats));
+}
+
+static int present_main (void *data) {
+	staging_buffer *buf;
+	int i;
+	(void)data;
+	rSDL_LockMutex(present_lock);
+	if (open_renderer(present_width, present_height))
+		present_state = PRESENT_FAILED;
+	else
+		present_state = PRESENT_RUNNING;
+	rSDL_CondSignal(present_cond);
+	while (present_state == PRESENT_RUNNING) {
+		if (!queue_len) {
+			rSDL_CondWait(present_cond, present_lock);
+			continue;
+		}
+		present_busy = present_queue[0];
+		for (i = 1; i < queue_len; i++) present_queue[i - 1] = present_queue[i];
+		queue_len--;
+		buf = &staging[present_busy];
+		rSDL_UnlockMutex(present_lock);
+		for (i = 0; i < buf->numrects; i++)
+			if (upload_changed(&buf->rects[i], buf->pixels, SDLCL_surface->pitch, buf->palette)) break;
+		present_screen(&buf->cursor);
+		rSDL_LockMutex(present_lock);
+		publish_present_stats();
+		present_busy = -1;
+	}
+	/* The renderer has to be destroyed by the thread that created it */
+	close_renderer();
+	rSDL_UnlockMutex(present_lock);
+	return 0;
+}
+
+static void free_present_state (void) {
+	int i;
+	for (i = 0; i < MAX_STAGING; i++) {
+		free(staging[i].pixels);
+		staging[i].pixels = NULL;
+		free_cursor_shot(&staging[i].cursor);
+	}
+	queue_len = 0;
+	present_busy = -1;
+	if (present_cond) {
+		rSDL_DestroyCond(present_cond);
+		present_cond = NULL;
+	}
+	if (present_lock) {
+		rSDL_DestroyMutex(present_lock);
+		present_lock = NULL;
+	}
+}
+
+/* Returns 0 if the presenter thread is running and owns the renderer */
+static int start_present_thread (int width, int height) {
+	const char *env = getenv("SDLCL_PRESENT_THREAD");
+	num_staging = env ? atoi(env) : 0;
+	if (num_staging <= 0) return -1;
+	if (num_staging < 2) num_staging = 2;
+	if (num_staging > MAX_STAGING) num_staging = MAX_STAGING;
+	present_lock = rSDL_CreateMutex();
+	present_cond = rSDL_CreateCond();
+	if (!present_lock || !present_cond) {
+		free_present_state();
+		return -1;
+	}
+	present_width = width;
+	present_height = height;
+	present_state = PRESENT_STARTING;
+	memset(&present_stats, 0, sizeof(present_stats));
+	upload_stats = &present_stats;
+	rSDL_LockMutex(present_lock);
+	present_thread = rSDL_CreateThread(present_main, "SDLCL presenter", NULL);
+	if (present_thread) {
+		while (present_state == PRESENT_STARTING)
+			rSDL_CondWait(present_cond, present_lock);
+	}
+	rSDL_UnlockMutex(present_lock);
+	if (present_thread && present_state == PRESENT_FAILED) {
+		rSDL_WaitThread(present_thread, NULL);
+		present_thread = NULL;
+	}
+	if (!present_thread) {
+		upload_stats = &video_stats;
+		free_present_state();
+		return -1;
+	}
+	return 0;
+}
+
+static void stop_present_thread (void) {
+	if (!present_thread) return;
+	rSDL_LockMutex(present_lock);
+	present_state = PRESENT_QUIT;
+	rSDL_CondSignal(present_cond);
+	rSDL_UnlockMutex(present_lock);
+	rSDL_WaitThread(present_thread, NULL);
+	present_thread = NULL;
+	upload_stats = &video_stats;
+	free_present_state();
+}
+
+/* Snapshot the dirty rectangles of the screen for the presenter thread */
+static int queue_frame (const SDL_Rect *rects, int numrects) {
+	staging_buffer *buf;
+	size_t offset;
+	int pitch = SDLCL_surface->pitch;
+	int bytespp = SDLCL_surface->format->BytesPerPixel;
+	int index, fresh, i, j;
+	rSDL_LockMutex(present_lock);
+	for (index = 0; index < num_staging; index++) {
+		if (index == present_busy) continue;
+		for (j = 0; j < queue_len && present_queue[j] != index; j++);
+		if (j == queue_len) break;
+	}
+	fresh = index < num_staging;
+	if (!fresh) index = present_queue[queue_len - 1];
+	buf = &staging[index];
+	if (!buf->pixels) {
+		buf->pixels = malloc(pitch * SDLCL_surface->h);
+		if (!buf->pixels) {
+			rSDL_UnlockMutex(present_lock);
+			return -1;
+		}
+	}
+	if (fresh) buf->numrects = 0;
+	for (i = 0; i < numrects; i++)
+		merge_rect(buf->rects, &buf->numrects, &rects[i]);
+	if (SDL_LockSurface(SDLCL_surface)) {
+		rSDL_UnlockMutex(present_lock);
+		return -1;
+	}
+	for (i = 0; i < buf->numrects; i++) {
+		offset = buf->rects[i].y * pitch + buf->rects[i].x * bytespp;
+		for (j = 0; j < buf->rects[i].h; j++)
+			memcpy(buf->pixels + offset + j * pitch,
+				(Uint8 *)SDLCL_surface->pixels + offset + j * pitch,
+				buf->rects[i].w * bytespp);
+	}
+	SDL_UnlockSurface(SDLCL_surface);
+	if (bytespp == 1) memcpy(buf->palette, physical_palette, sizeof(physical_palette));
+	capture_cursor(&buf->cursor);
+	if (fresh) {
+		present_queue[queue_len++] = index;
+		rSDL_CondSignal(present_cond);
+	}
+	rSDL_UnlockMutex(present_lock);
 	return 0;
 }
 
-/* TODO: Implement partial screen updates? */
+static int update_screen (const SDL_Rect *rects, int numrects) {
+	SDL_Rect full;
+	int i, ret = 0;
+	if (palette_dirty) {
+		/* Goes for the tiles and the presenter thread as well */
+		palette_dirty = 0;
+		full.x = full.y = 0;
+		full.w = SDLCL_surface->w;
+		full.h = SDLCL_surface->h;
+		rects = &full;
+		numrects = 1;
+	}
+	if (present_thread) return queue_frame(rects, numrects);
+	if (SDL_LockSurface(SDLCL_surface)) return -1;
+	for (i = 0; i < numrects; i++) {
+		if (zero_copy) {
+			ret = commit_rect(&rects[i]);
+			if (ret == -2) {
+				SDL_Rect rect;
+				rect.x = rect.y = 0;
+				rect.w = SDLCL_surface->w;
+				rect.h = SDLCL_surface->h;
+				ret = upload_screen_rect(&rect);
+				break;
+			}
+		} else {
+			ret = upload_screen_rect(&rects[i]);
+		}
+		if (ret) break;
+	}
+	SDL_UnlockSurface(SDLCL_surface);
+	if (!ret) {
+		capture_cursor(&screen_cursor);
+		present_screen(&screen_cursor);
+	}
+	return ret;
+}
+
+/* Stop the presenter thread and create the renderer again on the calling
+ * thread, for code that draws to the renderer directly
+ */
+void SDLCL_SyncPresent (void) {
+	SDL_Rect rect;
+	if (!present_thread) return;
+	stop_present_thread();
+	if (open_renderer(SDLCL_surface->w, SDLCL_surface->h)) return;
+	if (tile_size) memset(tile_stale, 1, tiles_across * tiles_down);
+	rect.x = rect.y = 0;
+	rect.w = SDLCL_surface->w;
+	rect.h = SDLCL_surface->h;
+	update_screen(&rect, 1);
+}
+
+/* With SDLCL_DEFER_PRESENT set to a number of milliseconds, screen updates
+ * only accumulate dirty rectangles. They are uploaded and presented together
+ * on the next SDL_PumpEvents(), or once the rectangles have been pending
+ * for that long (checked by later updates and SDL_Delay()). Updates read
+ * the live screen, so they are only presented where the application isn't
+ * in the middle of drawing.
+ */
+static void init_defer (void) {
+	const char *env = getenv("SDLCL_DEFER_PRESENT");
+	int budget = env ? atoi(env) : 0;
+	defer_budget = budget > 0 ? budget : 0;
+	num_pending = 0;
+	defer_thread = rSDL_ThreadID();
+}
+
+void SDLCL_FlushScreen (void) {
+	int num = num_pending;
+	if (!num) return;
+	num_pending = 0;
+	if (SDLCL_renderer) update_screen(pending_rects, num);
+}
+
+static int request_update (const SDL_Rect *rects, int numrects) {
+	int i;
+	if (!defer_budget) return update_screen(rects, numrects);
+	if (!num_pending) pending_since = rSDL_GetTicks();
+	for (i = 0; i < numrects; i++)
+		merge_rect(pending_rects, &num_pending, &rects[i]);
+	if (rSDL_GetTicks() - pending_since >= defer_budget) SDLCL_FlushScreen();
+	return 0;
+}
+
+/* Called from SDL_Delay(), so that updates left pending while the
+ * application waits are still presented once they are due. Presents them if they are, and returns the number of milliseconds
+ * until they will be otherwise, or 0 if none are pending.
+ */
+Uint32 SDLCL_FlushDueScreen (void) {
+	Uint32 waited;
+	if (!num_pending || rSDL_ThreadID() != defer_thread) return 0;
+	waited = rSDL_GetTicks() - pending_since;
+	if (waited < defer_budget) return defer_budget - waited;
+	SDLCL_FlushScreen();
+	return 0;
+}
+
+DECLSPEC int SDLCALL SDL_Flip (SDL1_Surface *screen) {
+	SDL_Rect rect;
+	Uint64 start;
+	int ret;
+	(void)screen;
+	if (!SDLCL_renderer) return 0;
+	start = SDLCL_StatStart();
+	rect.x = rect.y = 0;
+	rect.w = SDLCL_surface->w;
+	rect.h = SDLCL_surface->h;
+	ret = request_update(&rect, 1);
+	SDLCL_StatEnd(SDLCL_STAT_FLIP, start);
+	return ret;
+}
+
 DECLSPEC void SDLCALL SDL_UpdateRect (SDL1_Surface *screen, Sint32 x, Sint32 y, Sint32 w, Sint32 h) {
-	(void)x;
-	(void)y;
-	(void)w;
-	(void)h;
-	SDL_Flip(screen);
+	SDL_Rect rect;
+	Uint64 start;
+	if (!SDLCL_renderer || screen != SDLCL_surface) return;
+	if (!x && !y && !w && !h) {
+		/* Timed as a flip */
+		SDL_Flip(screen);
+		return;
+	}
+	start = SDLCL_StatStart();
+	/* As in SDL 1.2, a zero width or height extends to the screen's */
+	rect.x = x;
+	rect.y = y;
+	rect.w = w ? w : SDLCL_surface->w;
+	rect.h = h ? h : SDLCL_surface->h;
+	if (clip_update_rect(&rect)) request_update(&rect, 1);
+	SDLCL_StatEnd(SDLCL_STAT_UPDATERECTS, start);
 }
 
-/* TODO: Implement partial screen updates? */
 DECLSPEC void SDLCALL SDL_UpdateRects(SDL1_Surface *screen, int numrects, SDL1_Rect *rects)
 {
-	(void)numrects;
-	(void)rects;
-	SDL_Flip(screen);
+	SDL_Rect dirty[MAX_DIRTY_RECTS], rect;
+	int i, numdirty = 0;
+	Uint64 start;
+	if (!SDLCL_renderer || screen != SDLCL_surface) return;
+	start = SDLCL_StatStart();
+	for (i = 0; i < numrects; i++) {
+		rect.x = rects[i].x;
+		rect.y = rects[i].y;
+		rect.w = rects[i].w;
+		rect.h = rects[i].h;
+		if (clip_update_rect(&rect)) merge_rect(dirty, &numdirty, &rect);
+	}
+	if (numdirty) request_update(dirty, numdirty);
+	SDLCL_StatEnd(SDLCL_STAT_UPDATERECTS, start);
 }
 
 DECLSPEC int SDLCALL SDL_GetGammaRamp (Uint16 *redtable, Uint16 *greentable, Uint16 *bluetable) {
@@ -1052,12 +3056,30 @@ DECLSPEC int SDLCALL SDL_GL_LoadLibrary (const char *path) {
 }
 
 DECLSPEC void *SDLCALL SDL_GL_GetProcAddress (const char *proc) {
+	if (want_fbo()) {
+		if (!strcmp(proc, "glBindFramebuffer")) {
+			real_glBindFramebuffer = rSDL_GL_GetProcAddress(proc);
+			return real_glBindFramebuffer ? fbo_glBindFramebuffer : NULL;
+		}
+		if (!strcmp(proc, "glBindFramebufferEXT")) {
+			real_glBindFramebufferEXT = rSDL_GL_GetProcAddress(proc);
+			return real_glBindFramebufferEXT ? fbo_glBindFramebufferEXT : NULL;
+		}
+	}
 	return rSDL_GL_GetProcAddress(proc);
 }
 
 DECLSPEC void SDLCALL SDL_GL_SwapBuffers (void) {
-	if (SDLCL_scaling) gl_scale();
+	Uint64 start, stat_start = SDLCL_StatStart();
+	if (SDLCL_scaling) {
+		start = rSDL_GetPerformanceCounter();
+		if (gl_fbo) fbo_scale();
+		else gl_scale();
+		video_stats.scale_frames++;
+		video_stats.scale_usec += (rSDL_GetPerformanceCounter() - start) * 1000000 / rSDL_GetPerformanceFrequency();
+	}
 	rSDL_GL_SwapWindow(SDLCL_window);
+	SDLCL_StatEnd(SDLCL_STAT_GL_SWAP, stat_start);
 }
 
 typedef enum {
@@ -1297,26 +3319,6 @@ DECLSPEC int SDLCALL SDL_GetWMInfo (SDL1_SysWMinfo *info) {
 	return 0;
 }
 
-DECLSPEC int SDL_SoftStretch (SDL1_Surface *src, SDL1_Rect *srcrect, SDL1_Surface *dst, SDL1_Rect *dstrect) {
-	SDL_Rect srcrect2, dstrect2;
-	SDL_Rect *srcptr = NULL;
-	SDL_Rect *dstptr = NULL;
-	if (srcrect) {
-		srcrect2.x = srcrect->x;
-		srcrect2.y = srcrect->y;
-		srcrect2.w = srcrect->w;
-		srcrect2.h = srcrect->h;
-		srcptr = &srcrect2;
-	}
-	if (dstrect) {
-		dstrect2.x = dstrect->x;
-		dstrect2.y = dstrect->y;
-		dstrect2.w = dstrect->w;
-		dstrect2.h = dstrect->h;
-		dstptr = &dstrect2;
-	}
-	return rSDL_SoftStretch(src->sdl2_surface, srcptr, dst->sdl2_surface, dstptr);
-}
 
 #if defined(SDL_VIDEO_DRIVER_X11)
 #include <X11/Xutil.h>
@@ -97,13 +97,26 @@ extern int SDLCL_scaling;
 extern int SDLCL_virtual_width;
 extern int SDLCL_virtual_height;
 extern SDL_Rect SDLCL_scale_rect;
+extern int SDLCL_cursor_serial;
 extern void SDLCL_UpdateGrab (void);
+extern void SDLCL_FlushScreen (void);
+extern Uint32 SDLCL_FlushDueScreen (void);
+extern void SDLCL_SyncPresent (void);
+extern void SDLCL_QuitStretch (void);
 
 extern DECLSPEC int SDLCALL SDL_VideoInit (const char *driver_name, Uint32 flags);
 extern DECLSPEC void SDLCALL SDL_VideoQuit (void);
+extern DECLSPEC int SDLCALL SDL_LockSurface (SDL1_Surface *surface);
+extern DECLSPEC void SDLCALL SDL_UnlockSurface (SDL1_Surface *surface);
 
 extern DECLSPEC void SDLCALL SDL_SetCursor (SDL1_Cursor *cursor);
 extern DECLSPEC SDL1_Cursor *SDLCALL SDL_GetCursor (void);
 extern DECLSPEC int SDLCALL SDL_ShowCursor (int toggle);
 
+/* The extensions, declared with the types above */
+#define SDLCL_PIXELFORMAT SDL1_PixelFormat
+#define SDLCL_SURFACE SDL1_Surface
+#define SDLCL_RECT SDL1_Rect
+#include "sdlcl.h"
+
 #endif
@@ -59,6 +59,8 @@ DECLSPEC SDL1_Overlay *SDLCALL SDL_CreateYUVOverlay (int width, int height, Uint
 	int whalf = (width + 1) / 2;
 	int hhalf = (height + 1) / 2;
 	Uint8 *pixels;
+	/* Overlays are drawn with the renderer from this thread */
+	SDLCL_SyncPresent();
 	if (!SDLCL_renderer) return NULL;
 	/* TODO: Support software overlays for other surfaces */
 	if (display != SDLCL_surface) return NULL;